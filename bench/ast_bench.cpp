@@ -0,0 +1,136 @@
+#include "bits/stdc++.h"
+#include "../tokenizer/tokenizer.hpp"
+#include "../parser/parser.hpp"
+
+// usage: ast_bench [file]
+// compares the pointer tree with the flat arrays of the same AST:
+// memory and the time to walk all nodes
+
+std::string create_source(int funcs) {
+  std::string ret;
+  for (int i = 0; i < funcs; i++) {
+    std::string n = std::to_string(i);
+    ret += "func function_" + n + "(num argument_a, num argument_b) -> num\n";
+    ret += "  num local_x, local_y\n";
+    ret += "  local_x: argument_a + argument_b * " + n + " - (argument_a >> 2)\n";
+    ret += "  if local_x <= 1234567890\n";
+    ret += "    local_y: function_" + n + "(local_x - 1, argument_b) || 0\n";
+    ret += "  elif local_x == 3\n";
+    ret += "    local_y: (local_x + 1) * (local_x - 1) + argument_a % 7\n";
+    ret += "  return local_x + local_y\n";
+  }
+  return ret;
+}
+
+// counts nodes and adds up the bytes the tree owns
+class TreeWalker : public parser::Visitor<TreeWalker> {
+  public:
+  size_t nodes, heap_bytes, numbers;
+  TreeWalker() : nodes(0), heap_bytes(0), numbers(0) {}
+  template <class T> void visit_vec(std::vector<T *> &v) {
+    heap_bytes += v.capacity() * sizeof(T *);
+    for (T *n: v) visit(n);
+  }
+  void leaf(parser::AST *) { nodes++; }
+  void visit_type_spec(parser::ASTTypeSpec *n) { leaf(n); }
+  void visit_declarator(parser::ASTDeclarator *n) { leaf(n); }
+  void visit_simple_expr(parser::ASTSimpleExpr *n) {
+    leaf(n);
+    numbers += n->op.type == tokenizer::NumberConstant;
+  }
+  void visit_primary_expr(parser::ASTPrimaryExpr *n) { leaf(n); visit(n->expr); }
+  void visit_func_call_expr(parser::ASTFuncCallExpr *n) { leaf(n); visit(n->primary); visit_vec(n->args); }
+  void visit_binary_expr(parser::ASTExpr *n) { leaf(n); visit(n->left); visit(n->right); }
+  void visit_expr_stmt(parser::ASTExprStmt *n) { leaf(n); visit(n->expr); }
+  void visit_return_stmt(parser::ASTReturnStmt *n) { leaf(n); visit(n->expr); }
+  void visit_break_stmt(parser::ASTBreakStmt *n) { leaf(n); }
+  void visit_continue_stmt(parser::ASTContinueStmt *n) { leaf(n); }
+  void visit_declaration(parser::ASTDeclaration *n) { leaf(n); visit(n->declaration_spec); visit_vec(n->declarators); }
+  void visit_external_declaration(parser::ASTExternalDeclaration *n) { leaf(n); visit(n->declaration_spec); visit_vec(n->declarators); }
+  void visit_simple_declaration(parser::ASTSimpleDeclaration *n) { leaf(n); visit(n->type_spec); visit(n->declarator); }
+  void visit_comp_stmt(parser::ASTCompoundStmt *n) { leaf(n); visit_vec(n->items); }
+  void visit_if_stmt(parser::ASTIfStmt *n) {
+    leaf(n);
+    visit(n->cond);
+    visit(n->true_stmt);
+    if (n->false_stmt) visit(n->false_stmt);
+  }
+  void visit_else_stmt(parser::ASTElseStmt *n) {
+    leaf(n);
+    if (n->cond) visit(n->cond);
+    visit(n->true_stmt);
+    if (n->false_stmt) visit(n->false_stmt);
+  }
+  void visit_func_declarator(parser::ASTFuncDeclarator *n) { leaf(n); visit(n->declarator); visit_vec(n->args); }
+  void visit_func_declaration(parser::ASTFuncDeclaration *n) { leaf(n); visit(n->type_spec); visit(n->declarator); }
+  void visit_func_def(parser::ASTFuncDef *n) { leaf(n); visit(n->declaration); visit(n->body); }
+  void visit_translation_unit(parser::ASTTranslationUnit *n) { leaf(n); visit_vec(n->external_declarations); }
+};
+
+size_t count_flat_numbers(parser::FlatAST &ast, std::vector<tokenizer::Token> &tokens) {
+  size_t ret = 0;
+  for (uint32_t i = 0; i < ast.size(); i++) {
+    ret += ast.kind(i) == parser::AST::SimpleExpr &&
+           tokens[ast.tokens[i]].type == tokenizer::NumberConstant;
+  }
+  return ret;
+}
+
+// keeps the walks from being optimized out
+volatile size_t sink;
+
+template <class F> double measure(F f, int reps) {
+  double best = 1e100;
+  for (int i = 0; i < reps; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    best = std::min(best, d.count());
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  std::string source;
+  if (argc > 1) {
+    std::ifstream ifs(argv[1]);
+    std::ostringstream ost;
+    ost << ifs.rdbuf();
+    source = ost.str();
+  } else {
+    source = create_source(50000);
+  }
+
+  tokenizer::LineTable lines;
+  tokenizer::NameTable names;
+  std::vector<tokenizer::Token> tokens = tokenizer::tokenize(source, lines, names);
+  parser::Arena arena;
+  parser::Error err;
+  parser::AST *tree = parser::parse(tokens, arena, err);
+  if (!tree) {
+    std::cerr << err.get_error_string(lines) << std::endl;
+    return 1;
+  }
+  parser::FlatAST flat = parser::flatten(tree, tokens);
+
+  TreeWalker walker;
+  walker.visit(tree);
+  if (walker.nodes != flat.size() || walker.numbers != count_flat_numbers(flat, tokens)) {
+    std::cerr << "flat AST differs" << std::endl;
+    return 1;
+  }
+  size_t tree_bytes = arena.blocks.size() * parser::Arena::block_size +
+                      arena.dtors.capacity() * sizeof(arena.dtors[0]) + walker.heap_bytes;
+
+  double t_tree = measure([&]() {
+    TreeWalker w;
+    w.visit(tree);
+    sink = w.numbers;
+  }, 5);
+  double t_flat = measure([&]() { sink = count_flat_numbers(flat, tokens); }, 5);
+  std::cout << flat.size() << " nodes" << std::endl;
+  std::cout << "tree: " << tree_bytes / flat.size() << " bytes/node, "
+            << t_tree * 1e9 / flat.size() << " ns/node" << std::endl;
+  std::cout << "flat: " << flat.bytes() / flat.size() << " bytes/node, "
+            << t_flat * 1e9 / flat.size() << " ns/node" << std::endl;
+}
@@ -0,0 +1,202 @@
+#include "bits/stdc++.h"
+#include "../tokenizer/tokenizer.hpp"
+
+// usage: lexer_bench [file]
+// compares the table-driven lexer with the previous one
+// and reports bytes per second of each
+
+namespace legacy {
+  using namespace tokenizer;
+
+  // it does not tell kinds of punctuators apart
+  constexpr TokenType Punctuator = LF;
+  // a space or an empty line, which the current lexer skips
+  constexpr TokenType Delimiter = TokenType(Unknown + 1);
+
+  // the lexer before the table-driven one, kept as a reference
+  // "|" and "==" are lexed as the current lexer does
+  std::optional<Token> create_next_token_sub(const char *p, bool is_indent) {
+    if (!*p) return std::nullopt;
+    if ('0' <= *p && *p <= '9') {
+      int len = 0;
+      while ('0' <= p[len] && p[len] <= '9') len++;
+      return Token(p, len, NumberConstant);
+    }
+    if (('A' <= *p && *p <= 'Z') || ('a' <= *p && *p <= 'z') || *p == '_') {
+      int len = 0;
+      while (('A' <= p[len] && p[len] <= 'Z') ||
+            ('a' <= p[len] && p[len] <= 'z') || p[len] == '_' ||
+            ('0' <= p[len] && p[len] <= '9')) len++;
+      Token ret = Token(p, len, Ident);
+      if (ret.sv == "break") ret.type = KwBreak;
+      else if (ret.sv == "continue") ret.type = KwContinue;
+      else if (ret.sv == "elif") ret.type = KwElif;
+      else if (ret.sv == "else") ret.type = KwElse;
+      else if (ret.sv == "func") ret.type = KwFunc;
+      else if (ret.sv == "funcp") ret.type = KwFuncp;
+      else if (ret.sv == "if") ret.type = KwIf;
+      else if (ret.sv == "loop") ret.type = KwLoop;
+      else if (ret.sv == "num") ret.type = KwNum;
+      else if (ret.sv == "return") ret.type = KwReturn;
+      else if (ret.sv == "str") ret.type = KwStr;
+      return ret;
+    }
+    if ('!' == *p && p[1] == '=') return Token(p, 2, Punctuator);
+    if ('&' == *p) {
+      if (p[1] == '&') return Token(p, 2, Punctuator);
+      return Token(p, 1, Punctuator);
+    }
+    if ('|' == *p) {
+      if (p[1] == '|') return Token(p, 2, Punctuator);
+      return Token(p, 1, Punctuator);
+    }
+    if ('=' == *p) {
+      if (p[1] == '=') return Token(p, 2, Punctuator);
+      return Token(p, 1, Punctuator);
+    }
+    if ('<' == *p) {
+      if (p[1] == '<' || p[1] == '=') return Token(p, 2, Punctuator);
+      return Token(p, 1, Punctuator);
+    }
+    if ('>' == *p) {
+      if (p[1] == '>' || p[1] == '=') return Token(p, 2, Punctuator);
+      return Token(p, 1, Punctuator);
+    }
+    if ('-' == *p) {
+      if (p[1] == '>') return Token(p, 2, Punctuator);
+      return Token(p, 1, Punctuator);
+    }
+    if ('\n' == *p) {
+      if ('\n' == p[1]) return Token(p, 1, Delimiter);
+      return Token(p, 1, Punctuator);
+    }
+    if (' ' == *p) {
+      if (!is_indent) return Token(p, 1, Delimiter);
+      int len = 0;
+      while (' ' == p[len]) {
+        if (' ' == p[++len]) len++;
+        else return Token(p, len, Unknown);
+      }
+      return Token(p, len, Punctuator);
+    }
+    if (std::string_view(":^~+/*%()[],").find(*p) != std::string_view::npos) {
+      return Token(p, 1, Punctuator);
+    }
+    return Token(p, 1, Unknown);
+  }
+
+  // it also runs the pass that used to remove delimiters
+  std::vector<Token> tokenize(std::string &source) {
+    std::vector<Token> tokens;
+    bool is_indent = true;
+    const char *p = source.data();
+    std::optional<Token> t;
+    while ((t = create_next_token_sub(p, is_indent))) {
+      if (t->type != Delimiter) tokens.push_back(*t);
+      p += t->sv.length();
+      is_indent = t->sv == "\n" && t->type == Punctuator;
+    }
+    return tokens;
+  }
+}
+
+std::string create_source(int funcs) {
+  std::string ret;
+  for (int i = 0; i < funcs; i++) {
+    std::string n = std::to_string(i);
+    ret += "func function_" + n + "(num argument_a, num argument_b) -> num\n";
+    ret += "  num local_x, local_y\n";
+    ret += "  local_x: argument_a + argument_b * " + n + " - (argument_a >> 2)\n";
+    ret += "\n";
+    ret += "  if local_x <= 1234567890\n";
+    ret += "    local_y: function_" + n + "(local_x - 1, argument_b) || 0\n";
+    ret += "  return local_x + local_y\n\n";
+  }
+  return ret;
+}
+
+template <class F> double measure(F f, int reps) {
+  double best = 1e100;
+  for (int i = 0; i < reps; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    best = std::min(best, d.count());
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  std::string source;
+  if (argc > 1) {
+    std::ifstream ifs(argv[1]);
+    std::ostringstream ost;
+    ost << ifs.rdbuf();
+    source = ost.str();
+  } else {
+    source = create_source(100000);
+  }
+
+  tokenizer::LineTable lines;
+  tokenizer::NameTable names;
+  std::vector<tokenizer::Token> expected = legacy::tokenize(source);
+  std::vector<tokenizer::Token> actual = tokenizer::tokenize(source, lines, names);
+  if (expected.size() != actual.size()) {
+    std::cerr << "token count differs: " << expected.size()
+              << " != " << actual.size() << std::endl;
+    return 1;
+  }
+  for (int i = 0; i < (int)expected.size(); i++) {
+    bool same_type = expected[i].type == actual[i].type || (
+      expected[i].type == legacy::Punctuator &&
+      tokenizer::is_punctuator(actual[i].type)
+    );
+    if (
+      !same_type ||
+      expected[i].sv.data() != actual[i].sv.data() ||
+      expected[i].sv.length() != actual[i].sv.length()
+    ) {
+      std::cerr << "token " << i << " differs" << std::endl;
+      return 1;
+    }
+  }
+
+  double t_legacy = measure([&]() { legacy::tokenize(source); }, 5);
+  double t_table = measure([&]() {
+    tokenizer::LineTable l;
+    tokenizer::NameTable n;
+    tokenizer::tokenize(source, l, n);
+  }, 5);
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+  tokenizer::LineTable parallel_lines;
+  tokenizer::NameTable parallel_names;
+  std::vector<tokenizer::Token> parallel = tokenizer::tokenize(
+    source, parallel_lines, parallel_names, jobs
+  );
+  bool same_ids = parallel.size() == actual.size();
+  for (size_t i = 0; same_ids && i < actual.size(); i++) {
+    same_ids = parallel[i].id == actual[i].id;
+  }
+  if (!same_ids || parallel_lines.line_begins != lines.line_begins ||
+      parallel_names.names != names.names) {
+    std::cerr << "parallel lexing differs" << std::endl;
+    return 1;
+  }
+  double t_parallel = measure([&]() {
+    tokenizer::LineTable l;
+    tokenizer::NameTable n;
+    tokenizer::tokenize(source, l, n, jobs);
+  }, 5);
+  double mb = source.size() / 1e6;
+  std::cout << source.size() << " bytes, " << actual.size() << " tokens" << std::endl;
+  std::cout << "legacy: " << mb / t_legacy << " MB/s" << std::endl;
+#if defined(__AVX2__)
+  std::cout << "table (AVX2): ";
+#elif defined(__SSE2__)
+  std::cout << "table (SSE2): ";
+#else
+  std::cout << "table (scalar): ";
+#endif
+  std::cout << mb / t_table << " MB/s" << std::endl;
+  std::cout << "table, " << jobs << " threads: " << mb / t_parallel << " MB/s" << std::endl;
+}
@@ -0,0 +1,46 @@
+#!/bin/bash
+# compiles and runs an if with 100000 elifs and ifs nested 2000 deep
+# at each level, each must return 42
+# both compile in seconds, the timeout is there to catch a blowup
+cd "$(dirname "$0")/.."
+dir=$(mktemp -d)
+trap 'rm -rf $dir' EXIT
+
+# f(0) goes through all the conditions, which are 0, to the else
+elif_chain() {
+  printf 'func f(num a) -> num\n  if a\n    return 0\n'
+  for ((i = 1; i <= $1; i++)); do printf '  elif a * %d\n    return %d\n' $i $i; done
+  printf '  else\n    return 42\n\nfunc main() -> num\n  return f(0)\n'
+}
+
+# f(1) goes through all the ifs to the innermost return
+nested_if() {
+  local indent='  '
+  printf 'func f(num a) -> num\n'
+  for ((i = 0; i < $1; i++)); do
+    printf '%sif a\n' "$indent"
+    indent="$indent  "
+  done
+  printf '%sreturn 42\n  return 0\n\nfunc main() -> num\n  return f(1)\n' "$indent"
+}
+
+elif_chain 100000 > $dir/elif.l4t
+nested_if 2000 > $dir/nest.l4t
+
+status=0
+for f in $dir/*.l4t; do
+  for o in -O0 -O1 -O2 --stream; do
+    if ! timeout 60 ./l4tc $o -o $dir/out.S $f; then
+      echo "$(basename $f) $o: compile failed" >&2
+      status=1
+      continue
+    fi
+    gcc -z noexecstack -o $dir/out $dir/out.S && $dir/out
+    ret=$?
+    if [ $ret -ne 42 ]; then
+      echo "$(basename $f) $o: returned $ret" >&2
+      status=1
+    fi
+  done
+done
+exit $status
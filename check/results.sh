@@ -0,0 +1,58 @@
+#!/bin/bash
+# runs each program in check/programs at -O0, -O1 and -O2,
+# it must return the same exit code at each, or be rejected by check
+cd "$(dirname "$0")/.."
+dir=$(mktemp -d)
+trap 'rm -rf $dir' EXIT
+
+status=0
+# expect <program> <exit code>
+expect() {
+  for o in -O0 -O1 -O2; do
+    if ! ./l4tc $o -o $dir/out.S check/programs/$1.l4t; then
+      echo "$1 $o: compile failed" >&2
+      status=1
+      continue
+    fi
+    gcc -z noexecstack -o $dir/out $dir/out.S && $dir/out
+    ret=$?
+    if [ $ret -ne $2 ]; then
+      echo "$1 $o: returned $ret, not $2" >&2
+      status=1
+    fi
+  done
+}
+
+# reject <program> <part of the diagnostic>, which starts with the path
+reject() {
+  if ./l4tc -o $dir/out.S check/programs/$1.l4t 2> $dir/err ||
+     ! grep -qF "check/programs/$1.l4t:line:" $dir/err || ! grep -qF "$2" $dir/err; then
+    echo "$1: not rejected with $2" >&2
+    status=1
+  fi
+}
+
+# frame <program> <function> <bytes of its frame at -O0>
+frame() {
+  if ! ./l4tc -O0 check/programs/$1.l4t | grep -A3 -x "$2:" | grep -qx "sub rsp, $3"; then
+    echo "$1 $2: the frame is not $3 bytes" >&2
+    status=1
+  fi
+}
+
+# a declaration after the return is used before it
+expect hoist 7
+# 2^64 - 1 is -1
+expect max_literal 42
+reject big_literal '`99999999999999999999` does not fit in 64 bits'
+# sized integers wrap to their width when stored, passed and returned,
+# and are sign or zero extended when read; each returns the number of
+# the first check that fails, or 42
+expect sized_locals 42
+expect sized_args 42
+expect sized_globals 42
+# i8, num, i8, num, i16, i32 pack into 8 + 8 + 4 + 2 + 1 + 1 bytes,
+# aligned in the order they are declared they would take 40
+frame sized_locals mixed 24
+
+exit $status
@@ -0,0 +1,39 @@
+#!/bin/bash
+# compiles programs with and without --stream, the output must be the same
+# operators held while deep nesting is parsed outlive the 64-token window
+cd "$(dirname "$0")/.."
+dir=$(mktemp -d)
+trap 'rm -rf $dir' EXIT
+
+# (x4 - (x3 - (... - x0))), depth deep
+nested_sub() {
+  local e=x0
+  for ((i = 1; i <= $1; i++)); do e="(x$((i % 5)) - $e)"; done
+  printf 'func f(num x0, num x1, num x2, num x3, num x4) -> num\n  return %s\n\n' "$e"
+  printf 'func main() -> num\n  return f(1, 10, 100, 1000, 10000)\n'
+}
+
+# (a - (a - (... - a))), depth deep
+same_sub() {
+  local e=a
+  for ((i = 1; i <= $1; i++)); do e="(a - $e)"; done
+  printf 'func f(num a) -> num\n  return %s\n\n' "$e"
+  printf 'func main() -> num\n  return f(7)\n'
+}
+
+nested_sub 24 > $dir/nested_sub.l4t
+nested_sub 200 > $dir/nested_sub_200.l4t
+same_sub 20 > $dir/same_sub.l4t
+cp main.l4t $dir/main.l4t
+
+status=0
+for f in $dir/*.l4t; do
+  for o in -O0 -O1 -O2; do
+    ./l4tc $o $f > $dir/batch.S && ./l4tc $o --stream $f > $dir/stream.S || { status=1; continue; }
+    if ! cmp -s $dir/batch.S $dir/stream.S; then
+      echo "$(basename $f) $o: --stream differs" >&2
+      status=1
+    fi
+  done
+done
+exit $status
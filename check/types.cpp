@@ -0,0 +1,42 @@
+#include "bits/stdc++.h"
+#include "../generator/generator.hpp"
+
+// interns the same nested signatures twice in a TypeContext,
+// each must come back as the same pointer
+// the parser can't read funcp or pointer types yet, so they are
+// built here the way create_type would build them
+
+using namespace generator;
+
+// funcp (num, funcp (num*) -> num) -> funcp (num) -> num*
+EvalType *nested(TypeContext &types) {
+  std::vector<EvalType *> inner_args = {types.pointer(types.num())};
+  EvalType *inner = types.func(inner_args, types.num());
+  std::vector<EvalType *> ret_args = {types.num()};
+  EvalType *ret = types.func(ret_args, types.pointer(types.num()));
+  std::vector<EvalType *> args = {types.num(), inner};
+  return types.func(args, ret);
+}
+
+int main() {
+  TypeContext types;
+  int failed = 0;
+  auto expect = [&](bool ok, const char *what) {
+    if (ok) return;
+    std::cerr << "failed: " << what << std::endl;
+    failed++;
+  };
+
+  EvalType *a = nested(types), *b = nested(types);
+  expect(a == b, "the same nested signature is one type");
+  expect(types.pointer(a) == types.pointer(b), "pointers to it are one type");
+  expect(types.func_types.size() == 3, "each signature is interned once");
+
+  // only the innermost argument differs
+  std::vector<EvalType *> inner_args = {types.num()};
+  EvalType *inner = types.func(inner_args, types.num());
+  std::vector<EvalType *> args = {types.num(), inner};
+  EvalType *c = types.func(args, static_cast<TypeFunc *>(a)->ret_type);
+  expect(a != c, "a different nested signature is another type");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+#include "./generator.hpp"
+
+namespace generator {
+  // only the last statement of a block is looked at, it is the one
+  // that returns once remove_dead_code has run
+  bool always_returns(AST *n) {
+    switch (n->kind) {
+    case AST::ReturnStmt:
+      return true;
+    case AST::CompoundStmt: {
+      std::vector<AST *> &items = static_cast<ASTCompoundStmt *>(n)->items;
+      return !items.empty() && always_returns(items.back());
+    }
+    case AST::IfStmt: {
+      ASTIfStmt *s = static_cast<ASTIfStmt *>(n);
+      ASTElseStmt *e = s->false_stmt;
+      while (e && e->cond) e = e->false_stmt;
+      // without else, or the branches are looked at for nothing
+      if (!e || !always_returns(s->true_stmt)) return false;
+      for (e = s->false_stmt; e; e = e->false_stmt) {
+        if (!always_returns(e->true_stmt)) return false;
+      }
+      return true;
+    }
+    default:
+      return false;
+    }
+  }
+
+  // walks each function backwards from its end with the set of locals
+  // live there, by their offsets, which check made unique
+  // there are no loops, so one walk is enough
+  class DeadCode {
+    public:
+    std::vector<bool> live;
+
+    static ASTExpr *strip(ASTExpr *n) {
+      while (n->kind == AST::PrimaryExpr) n = static_cast<ASTPrimaryExpr *>(n)->expr;
+      return n;
+    }
+
+    // the local assigned by n, or null
+    static ASTSimpleExpr *stored_local(ASTExpr *n) {
+      if (n->kind != AST::AssignExpr) return nullptr;
+      ASTSimpleExpr *target = static_cast<ASTSimpleExpr *>(strip(n->left));
+      return target->is_global ? nullptr : target;
+    }
+
+    // no calls, no assignments and no divisions, which may trap
+    static bool is_pure(ASTExpr *n) {
+      n = strip(n);
+      switch (n->kind) {
+      case AST::SimpleExpr:
+        return true;
+      case AST::FuncCallExpr: case AST::AssignExpr:
+        return false;
+      case AST::MultiplicativeExpr:
+        if (static_cast<ASTMultiplicativeExpr *>(n)->op.type != StarTok) return false;
+        return is_pure(n->left) && is_pure(n->right);
+      default:
+        return is_pure(n->left) && is_pure(n->right);
+      }
+    }
+
+    // the locals n reads are live before it
+    void use(ASTExpr *n) {
+      n = strip(n);
+      switch (n->kind) {
+      case AST::SimpleExpr: {
+        ASTSimpleExpr *e = static_cast<ASTSimpleExpr *>(n);
+        if (e->is_assignable && !e->is_global) live[e->offset] = true;
+        break;
+      }
+      case AST::FuncCallExpr: {
+        ASTFuncCallExpr *c = static_cast<ASTFuncCallExpr *>(n);
+        use(c->primary);
+        for (ASTExpr *arg: c->args) use(arg);
+        break;
+      }
+      case AST::AssignExpr:
+        // the left side is where the value goes, not a read
+        if (!stored_local(n)) use(n->left);
+        use(n->right);
+        break;
+      default:
+        use(n->left);
+        use(n->right);
+        break;
+      }
+    }
+
+    // null if the statement is removed
+    AST *visit_stmt(AST *n) {
+      switch (n->kind) {
+      case AST::CompoundStmt:
+        visit_items(static_cast<ASTCompoundStmt *>(n));
+        return n;
+      case AST::IfStmt:
+        return visit_if(static_cast<ASTIfStmt *>(n));
+      case AST::ReturnStmt:
+        // nothing after a return runs
+        live.assign(live.size(), false);
+        use(static_cast<ASTExpr *>(static_cast<ASTReturnStmt *>(n)->expr));
+        return n;
+      case AST::ExprStmt:
+        return visit_expr_stmt(static_cast<ASTExprStmt *>(n));
+      default:
+        return n;
+      }
+    }
+
+    // a store to a local that is not live after it is dropped, and so
+    // is a statement that computes a value for nothing
+    AST *visit_expr_stmt(ASTExprStmt *n) {
+      ASTExpr *expr = strip(static_cast<ASTExpr *>(n->expr));
+      ASTSimpleExpr *target = stored_local(expr);
+      while (target && !live[target->offset]) {
+        expr = strip(expr->right);
+        target = stored_local(expr);
+      }
+      n->expr = expr;
+      if (is_pure(expr)) return nullptr;
+      if (target) live[target->offset] = false;
+      use(expr);
+      return n;
+    }
+
+    // statements after one that returns are never run
+    // whether n always returns, as always_returns after the cut
+    // declarations after it are kept, check hoisted them so the statements
+    // before may use them; they go first so the block still ends in a return
+    static bool cut_after_return(AST *n) {
+      switch (n->kind) {
+      case AST::ReturnStmt:
+        return true;
+      case AST::CompoundStmt: {
+        std::vector<AST *> &items = static_cast<ASTCompoundStmt *>(n)->items;
+        for (size_t i = 0; i < items.size(); i++) {
+          if (!cut_after_return(items[i])) continue;
+          auto end = std::stable_partition(items.begin() + i + 1, items.end(), [](AST *item) {
+            return item->kind == AST::Declaration;
+          });
+          std::rotate(items.begin(), items.begin() + i + 1, end);
+          items.erase(end, items.end());
+          return true;
+        }
+        return false;
+      }
+      case AST::IfStmt: {
+        ASTIfStmt *s = static_cast<ASTIfStmt *>(n);
+        bool ret = cut_after_return(s->true_stmt);
+        for (ASTElseStmt *e = s->false_stmt; e; e = e->false_stmt) {
+          ret = cut_after_return(e->true_stmt) && ret;
+          if (!e->cond) return ret;
+        }
+        return false; // without else
+      }
+      default:
+        return false;
+      }
+    }
+
+    void visit_items(ASTCompoundStmt *n) {
+      std::vector<AST *> &items = n->items;
+      for (size_t i = items.size(); i-- > 0;) items[i] = visit_stmt(items[i]);
+      items.erase(std::remove(items.begin(), items.end(), nullptr), items.end());
+    }
+
+    // each branch starts from what is live after the if, a condition
+    // that is 0 goes on to the next one, or after the if without else
+    // an if left with nothing to run and pure conditions is removed
+    AST *visit_if(ASTIfStmt *n) {
+      std::vector<std::pair<ASTExpr *, ASTCompoundStmt *>> branches = {{n->cond, n->true_stmt}};
+      for (ASTElseStmt *e = n->false_stmt; e; e = e->false_stmt) branches.push_back({e->cond, e->true_stmt});
+      std::vector<bool> after = live, next = live;
+      bool is_empty = true;
+      for (auto it = branches.rbegin(); it != branches.rend(); ++it) {
+        live = after;
+        visit_items(it->second);
+        is_empty = is_empty && it->second->items.empty() && (!it->first || is_pure(it->first));
+        if (!it->first) {
+          next = live;
+          continue;
+        }
+        for (size_t i = 0; i < live.size(); i++) live[i] = live[i] || next[i];
+        use(it->first);
+        next = live;
+      }
+      return is_empty ? nullptr : n;
+    }
+
+    void visit_func_def(ASTFuncDef *n) {
+      cut_after_return(n->body);
+      live.assign(n->frame_size + 1, false);
+      visit_items(n->body);
+    }
+  };
+
+  void remove_dead_code(AST *ast) {
+    DeadCode dce;
+    for (AST *d: static_cast<ASTTranslationUnit *>(ast)->external_declarations) {
+      if (d->kind == AST::FuncDef) dce.visit_func_def(static_cast<ASTFuncDef *>(d));
+    }
+  }
+}
@@ -0,0 +1,281 @@
+#include "./generator.hpp"
+
+namespace generator {
+  // check rejected literals that do not fit in 64 bits
+  int64_t number_value(Token &t) {
+    const char *p = t.sv.data(), *end = p + t.sv.size();
+    if (*p == '-') {
+      int64_t value = 0;
+      std::from_chars(p, end, value);
+      return value;
+    }
+    uint64_t value = 0;
+    std::from_chars(p, end, value);
+    return value;
+  }
+
+  // l op r as the generated code computes it, wrapping around in 64 bits
+  // false where the code would trap, a division by 0 or INT64_MIN / -1
+  static bool apply(TokenType op, int64_t l, int64_t r, int64_t &value) {
+    uint64_t a = l, b = r;
+    switch (op) {
+    case PlusTok: value = a + b; return true;
+    case MinusTok: value = a - b; return true;
+    case StarTok: value = a * b; return true;
+    case SlashTok: case PercentTok:
+      if (!r || (l == INT64_MIN && r == -1)) return false;
+      value = op == SlashTok ? l / r : l % r;
+      return true;
+    // the count is taken mod 64, as by shl and sar
+    case LessLessTok: value = a << (b & 63); return true;
+    case GreaterGreaterTok: value = l >> (b & 63); return true;
+    case LessTok: value = l < r; return true;
+    case GreaterTok: value = l > r; return true;
+    case LessEqualTok: value = l <= r; return true;
+    case GreaterEqualTok: value = l >= r; return true;
+    case EqualEqualTok: value = l == r; return true;
+    case NotEqualTok: value = l != r; return true;
+    case AmpTok: value = a & b; return true;
+    case CaretTok: value = a ^ b; return true;
+    case BarTok: value = a | b; return true;
+    case AmpAmpTok: value = l && r; return true;
+    case BarBarTok: value = l || r; return true;
+    default: return false;
+    }
+  }
+
+  bool constant_value(ASTExpr *n, int64_t &value) {
+    switch (n->kind) {
+    case AST::SimpleExpr: {
+      ASTSimpleExpr *e = static_cast<ASTSimpleExpr *>(n);
+      if (e->op.type != NumberConstant) return false;
+      value = number_value(e->op);
+      return true;
+    }
+    case AST::PrimaryExpr:
+      return constant_value(static_cast<ASTPrimaryExpr *>(n)->expr, value);
+    case AST::FuncCallExpr: case AST::AssignExpr:
+      return false;
+    default: {
+      int64_t l, r;
+      if (!constant_value(n->left, l) || !constant_value(n->right, r)) return false;
+      return apply(binary_operator(n).type, l, r, value);
+    }
+    }
+  }
+
+  // rewrites a checked tree bottom up, so the children of a node are
+  // folded when it is; parentheses are dropped on the way
+  // a variable operand is read late, when its operator runs, so a node
+  // is only replaced by a bare variable where nothing with effects runs
+  // between the two, or `(x * 1) + (x: 1)` would become `x + (x: 1)`
+  class Folder {
+    public:
+    Arena &arena;
+    Folder(Arena &a) : arena(a) {}
+
+    ASTExpr *constant(ASTExpr *n, int64_t value) {
+      std::string s = std::to_string(value);
+      char *p = (char *)arena.allocate(s.size(), 1);
+      memcpy(p, s.data(), s.size());
+      Token t(p, s.size(), NumberConstant);
+      ASTSimpleExpr *ret = arena.make<ASTSimpleExpr>(&t);
+      ret->eval_type = n->eval_type;
+      return ret;
+    }
+
+    static bool is_constant(ASTExpr *n, int64_t &value) {
+      if (n->kind != AST::SimpleExpr || static_cast<ASTSimpleExpr *>(n)->op.type != NumberConstant) return false;
+      value = number_value(static_cast<ASTSimpleExpr *>(n)->op);
+      return true;
+    }
+
+    // the same variable, read at the same time when both are operands
+    static bool is_same_var(ASTExpr *a, ASTExpr *b) {
+      if (a->kind != AST::SimpleExpr || b->kind != AST::SimpleExpr || !a->is_assignable || !b->is_assignable) return false;
+      ASTSimpleExpr *x = static_cast<ASTSimpleExpr *>(a), *y = static_cast<ASTSimpleExpr *>(b);
+      if (x->is_global != y->is_global) return false;
+      return x->is_global ? x->op.sv == y->op.sv : x->offset == y->offset;
+    }
+
+    // a division may trap, so dropping one is not free either
+    // n has no effects, so it has no calls or assignments
+    static bool may_trap(ASTExpr *n) {
+      switch (n->kind) {
+      case AST::SimpleExpr:
+        return false;
+      case AST::MultiplicativeExpr:
+        return static_cast<ASTMultiplicativeExpr *>(n)->op.type != StarTok || may_trap(n->left) || may_trap(n->right);
+      default:
+        return may_trap(n->left) || may_trap(n->right);
+      }
+    }
+
+    // e in place of n, unless e is a variable that must not be read late
+    static ASTExpr *keep(ASTExpr *n, ASTExpr *e, bool late) {
+      return late || !e->is_assignable ? e : n;
+    }
+
+    // late: n may be replaced by a variable read when its parent runs
+    ASTExpr *fold_expr(ASTExpr *n, bool late) {
+      // in a loop, parentheses may nest deeper than the call stack
+      while (n->kind == AST::PrimaryExpr) n = static_cast<ASTPrimaryExpr *>(n)->expr;
+      switch (n->kind) {
+      case AST::SimpleExpr:
+        n->has_effects = false;
+        return n;
+      case AST::AssignExpr:
+        // the left side is an address, nothing runs after the right side
+        n->right = fold_expr(n->right, true);
+        n->has_effects = true;
+        return n;
+      case AST::FuncCallExpr: {
+        ASTFuncCallExpr *c = static_cast<ASTFuncCallExpr *>(n);
+        c->primary = fold_expr(c->primary, false);
+        // variable args are read after all args run
+        bool effects = false;
+        for (auto it = c->args.rbegin(); it != c->args.rend(); ++it) {
+          *it = fold_expr(*it, !effects);
+          effects |= (*it)->has_effects;
+        }
+        n->has_effects = true;
+        return n;
+      }
+      default:
+        n->right = fold_expr(n->right, true);
+        n->left = fold_expr(n->left, !n->right->has_effects);
+        n->has_effects = n->left->has_effects || n->right->has_effects;
+        return simplify(n, late);
+      }
+    }
+
+    ASTExpr *simplify(ASTExpr *n, bool late) {
+      TokenType op = binary_operator(n).type;
+      int64_t l, r, value;
+      bool lc = is_constant(n->left, l), rc = is_constant(n->right, r);
+      if (lc && rc) return apply(op, l, r, value) ? constant(n, value) : n;
+      // constants go right, where add and imul take them as immediates
+      if (lc && (op == PlusTok || op == StarTok)) {
+        std::swap(n->left, n->right);
+        std::swap(l, r);
+        rc = true;
+      }
+      if (!rc) return op == MinusTok && is_same_var(n->left, n->right) ? constant(n, 0) : n;
+
+      ASTExpr *e = n->left;
+      int64_t c;
+      switch (op) {
+      case PlusTok: case MinusTok:
+        if (!r) return keep(n, e, late);
+        // (e + c) - r is e + (c - r)
+        if (e->kind == AST::AdditiveExpr && is_constant(e->right, c)) {
+          bool plus = static_cast<ASTAdditiveExpr *>(e)->op.type == PlusTok;
+          uint64_t sum = (plus ? (uint64_t)c : -(uint64_t)c) + (op == PlusTok ? (uint64_t)r : -(uint64_t)r);
+          e->right = constant(e->right, plus ? sum : -sum);
+          return simplify(e, late);
+        }
+        return n;
+      case StarTok:
+        if (r == 1) return keep(n, e, late);
+        if (!r && !e->has_effects && !may_trap(e)) return constant(n, 0);
+        if (e->kind == AST::MultiplicativeExpr && static_cast<ASTMultiplicativeExpr *>(e)->op.type == StarTok &&
+            is_constant(e->right, c)) {
+          e->right = constant(e->right, (uint64_t)c * r);
+          return simplify(e, late);
+        }
+        return n;
+      case SlashTok:
+        return r == 1 ? keep(n, e, late) : n;
+      case PercentTok:
+        return r == 1 && !e->has_effects && !may_trap(e) ? constant(n, 0) : n;
+      default:
+        return n;
+      }
+    }
+
+    AST *fold_stmt(AST *n) {
+      switch (n->kind) {
+      case AST::CompoundStmt:
+        fold_items(static_cast<ASTCompoundStmt *>(n));
+        return n;
+      case AST::IfStmt:
+        return fold_if(static_cast<ASTIfStmt *>(n));
+      case AST::ExprStmt: {
+        ASTExprStmt *s = static_cast<ASTExprStmt *>(n);
+        s->expr = fold_expr(static_cast<ASTExpr *>(s->expr), true);
+        return n;
+      }
+      case AST::ReturnStmt: {
+        ASTReturnStmt *s = static_cast<ASTReturnStmt *>(n);
+        s->expr = fold_expr(static_cast<ASTExpr *>(s->expr), true);
+        return n;
+      }
+      default:
+        return n;
+      }
+    }
+
+    // statements folded away are removed
+    void fold_items(ASTCompoundStmt *n) {
+      size_t size = 0;
+      for (AST *item: n->items) {
+        if ((item = fold_stmt(item))) n->items[size++] = item;
+      }
+      n->items.resize(size);
+    }
+
+    // a branch whose condition is 0 is dropped and one whose condition
+    // is another constant becomes the else, which ends the chain
+    // an if left with only an else is its compound stmt, one left with
+    // nothing is null
+    AST *fold_if(ASTIfStmt *n) {
+      std::vector<ASTElseStmt *> elses;
+      std::vector<std::pair<ASTExpr *, ASTCompoundStmt *>> branches = {{n->cond, n->true_stmt}};
+      for (ASTElseStmt *e = n->false_stmt; e; e = e->false_stmt) {
+        elses.push_back(e);
+        branches.push_back({e->cond, e->true_stmt});
+      }
+      size_t size = 0;
+      for (auto [cond, stmt]: branches) {
+        int64_t value;
+        if (cond) cond = fold_expr(cond, true);
+        if (cond && is_constant(cond, value)) {
+          if (!value) continue;
+          cond = nullptr;
+        }
+        fold_items(stmt);
+        branches[size++] = {cond, stmt};
+        if (!cond) break;
+      }
+      if (!size) return nullptr;
+      if (!branches[0].first) return branches[0].second;
+      n->cond = branches[0].first;
+      n->true_stmt = branches[0].second;
+      ASTElseStmt **tail = &n->false_stmt;
+      for (size_t i = 1; i < size; i++) {
+        *tail = elses[i - 1];
+        (*tail)->cond = branches[i].first;
+        (*tail)->true_stmt = branches[i].second;
+        tail = &(*tail)->false_stmt;
+      }
+      *tail = nullptr;
+      return n;
+    }
+
+    void fold(AST *ast) {
+      for (AST *d: static_cast<ASTTranslationUnit *>(ast)->external_declarations) {
+        if (d->kind == AST::FuncDef) {
+          fold_items(static_cast<ASTFuncDef *>(d)->body);
+        } else {
+          for (ASTDeclarator *decl: static_cast<ASTExternalDeclaration *>(d)->declarators) {
+            if (decl->init) decl->init = fold_expr(decl->init, true);
+          }
+        }
+      }
+    }
+  };
+
+  void fold(AST *ast, Arena &arena) {
+    Folder(arena).fold(ast);
+  }
+}
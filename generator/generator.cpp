@@ -4,186 +4,214 @@ namespace generator {
   static int label_number = 0;
   const std::string param_reg_names[6] = {"rdi", "rsi", "rdx", "rcx", "r8",  "r9"};
 
-  std::shared_ptr<EvalType> create_base_type(std::shared_ptr<ASTTypeSpec> n) {
-    // TODO static, const
-    switch (n->op->type)
-    {
-    case KwNum:
-      return std::make_shared<TypeNum>();
-    default:
-      break;
-    }
-    assert(false);
-    return nullptr;
+  // names of the low 1, 2, 4 and 8 bytes of a register
+  const std::map<std::string, std::array<std::string, 4>> sized_reg_names = {
+    {"rax", {"al", "ax", "eax", "rax"}},
+    {"rcx", {"cl", "cx", "ecx", "rcx"}},
+    {"rdx", {"dl", "dx", "edx", "rdx"}},
+    {"rsi", {"sil", "si", "esi", "rsi"}},
+    {"rdi", {"dil", "di", "edi", "rdi"}},
+    {"r8", {"r8b", "r8w", "r8d", "r8"}},
+    {"r9", {"r9b", "r9w", "r9d", "r9"}},
+    {"r10", {"r10b", "r10w", "r10d", "r10"}},
+    {"r11", {"r11b", "r11w", "r11d", "r11"}},
+    {"rbx", {"bl", "bx", "ebx", "rbx"}},
+    {"r12", {"r12b", "r12w", "r12d", "r12"}},
+    {"r13", {"r13b", "r13w", "r13d", "r13"}},
+    {"r14", {"r14b", "r14w", "r14d", "r14"}},
+    {"r15", {"r15b", "r15w", "r15d", "r15"}},
+  };
+
+  const std::string &sized_reg(const std::string &reg, int size) {
+    return sized_reg_names.at(reg)[__builtin_ctz(size)];
   }
 
-  std::shared_ptr<EvalType> create_type(std::shared_ptr<ASTDeclarator>, std::shared_ptr<EvalType> base_type) {
-    // TODO: pointer
-    return base_type;
+  void load(std::string &code, const std::string &reg, const std::string &addr, EvalType *t) {
+    int size = type_size(t);
+    bool is_signed = t && t->kind == EvalType::Num && static_cast<TypeNum *>(t)->is_signed;
+    // the size of the memory operand is only needed for movsx and movzx
+    if (size == 8) code += "mov " + reg + ", [" + addr + "]\n";
+    else if (size == 4 && is_signed) code += "movsxd " + reg + ", dword ptr [" + addr + "]\n";
+    else if (size == 4) code += "mov " + sized_reg(reg, 4) + ", [" + addr + "]\n";
+    else if (size == 2) code += (is_signed ? "movsx " : "movzx ") + reg + ", word ptr [" + addr + "]\n";
+    else code += (is_signed ? "movsx " : "movzx ") + reg + ", byte ptr [" + addr + "]\n";
   }
 
-  std::shared_ptr<TypeFunc> create_func_type(std::shared_ptr<ASTFuncDeclaration> fd) {
-    std::vector<std::shared_ptr<EvalType>> type_args;
-    for (std::shared_ptr<ASTSimpleDeclaration> d: fd->declarator->args) {
-      type_args.push_back(
-        create_type(d->declarator, create_base_type(d->type_spec))
-      );
-    }
-    return std::make_shared<TypeFunc>(
-      type_args,
-      create_type(
-        fd->declarator->declarator,
-        create_base_type(fd->type_spec)
-      )
-    );
+  void load(std::string &code, const std::string &reg, EvalType *t) {
+    load(code, reg, reg, t);
+  }
+
+  void extend(std::string &code, const std::string &reg, EvalType *t) {
+    int size = type_size(t);
+    if (size == 8) return;
+    bool is_signed = static_cast<TypeNum *>(t)->is_signed;
+    std::string src = sized_reg(reg, size);
+    if (size == 4 && is_signed) code += "movsxd " + reg + ", " + src + "\n";
+    else if (size == 4) code += "mov " + src + ", " + src + "\n";
+    else code += (is_signed ? "movsx " : "movzx ") + reg + ", " + src + "\n";
+  }
+
+  int64_t init_value(ASTDeclarator *d) {
+    int64_t value = 0;
+    constant_value(d->init, value);
+    int bits = 8 * type_size(d->type);
+    if (bits == 64) return value;
+    uint64_t low = (uint64_t)value & ((1ull << bits) - 1);
+    bool is_signed = static_cast<TypeNum *>(d->type)->is_signed;
+    return is_signed && low >> (bits - 1) ? (int64_t)(low - (1ull << bits)) : (int64_t)low;
   }
 
-  void generate_sub(std::shared_ptr<AST> ast, std::shared_ptr<Context> ctx, std::string &code) {
-    if (typeid(*ast) == typeid(ASTTranslationUnit)) {
-      std::shared_ptr<ASTTranslationUnit> n = std::dynamic_pointer_cast<ASTTranslationUnit>(ast);
+  void define_global(std::string &code, ASTDeclarator *d) {
+    static const char *directives[] = {".byte", ".short", ".long", ".quad"};
+    int size = type_size(d->type);
+    std::string name(d->op.sv);
+    code += ".data\n";
+    code += ".global " + name + "\n";
+    code += ".align " + std::to_string(size) + "\n";
+    code += name + ":\n";
+    code += std::string(directives[__builtin_ctz(size)]) + " " + std::to_string(init_value(d)) + "\n";
+    code += ".text\n";
+  }
+
+  // the register stack of -O1, rax and rdx are left to idiv and calls
+  static const std::string regs[] = {"r10", "r11", "rcx", "rsi", "rdi", "r8", "r9"};
+  static const int num_regs = 7;
+
+  class Generator : public Visitor<Generator> {
+    public:
+    std::shared_ptr<Context> ctx;
+    std::string &code;
+    EvalType *ret_type = nullptr; // of the function being generated
+    // evaluate expressions in registers instead of on the stack
+    bool registers;
+    Generator(std::string &c, bool r) : ctx(std::make_shared<Context>()), code(c), registers(r) {}
+
+    void visit_translation_unit(ASTTranslationUnit *n) {
       code += ".intel_syntax noprefix\n"; // use intel syntax
       code += ".text\n"; // text section
-      for (std::shared_ptr<AST> d: n->external_declarations) {
-        generate_sub(d, ctx, code);
+      for (AST *d: n->external_declarations) {
+        visit(d);
       }
-      return;
     }
-    // declaration-spec simple-declarators
-    if (typeid(*ast) == typeid(ASTExternalDeclaration)) {
-      std::shared_ptr<ASTExternalDeclaration> n = std::dynamic_pointer_cast<ASTExternalDeclaration>(ast);
-      std::shared_ptr<EvalType> base_type = create_base_type(n->declaration_spec);
-      for (std::shared_ptr<ASTDeclarator> d: n->declarators) {
-        ctx->add_global_var(std::string(d->op->sv), create_type(d, base_type));
+
+    // declaration-spec init-declarators
+    // globals without an initializer are defined elsewhere
+    void visit_external_declaration(ASTExternalDeclaration *n) {
+      for (ASTDeclarator *d: n->declarators) {
+        if (d->init) define_global(code, d);
       }
-      return;
     }
-    if (typeid(*ast) == typeid(ASTFuncDef)) {
-      std::shared_ptr<ASTFuncDef> n = std::dynamic_pointer_cast<ASTFuncDef>(ast);
-      std::shared_ptr<ASTFuncDeclaration> fd = n->declaration;
-      std::string func_name = std::string(fd->declarator->declarator->op->sv);
-      std::shared_ptr<TypeFunc> tf = create_func_type(fd);
-      std::vector<std::string> name_args;
-      if (fd->declarator->args.size() > 6) {
-        // TODO: the maximum number of arguments of function is 6 in l4t
-        assert(false);
-      }
-      for (std::shared_ptr<ASTSimpleDeclaration> d: fd->declarator->args) {
-        name_args.push_back(std::string(d->declarator->op->sv));
-      }
-      ctx->add_global_var(func_name, tf);
+
+    void visit_func_def(ASTFuncDef *n) {
+      ASTFuncDeclaration *fd = n->declaration;
+      std::string func_name = std::string(fd->declarator->declarator->op.sv);
+      std::vector<ASTSimpleDeclaration *> &args = fd->declarator->args;
       code += ".global " + func_name + "\n";
       code += func_name + ":\n";
       assert(ctx->rsp == 0); // here is global
       ctx->start_scope(); // remember rsp value
+      ret_type = static_cast<TypeFunc *>(fd->declarator->declarator->type)->ret_type;
       code += "push rbp\n";
       code += "mov rbp, rsp\n";
-      ctx->rsp = 0; // now rsp == rbp
-      // push arguments
-      code += "sub rsp, " + std::to_string((int)name_args.size() * 8) + "\n";
-      for (int i=0; i < (int)name_args.size(); i++) {
-        // all size of vars are 8 byte (64bit) in this l4tc
-        ctx->rsp -= 8;
-        // add vars in function arguments to local vars
-        ctx->add_local_var(name_args[i], tf->type_args[i]);
-        code += "mov [rbp - " + std::to_string(-ctx->rsp) + "], " + param_reg_names[i] + "\n";
+      // the whole frame laid out by check is allocated once
+      if (n->frame_size) code += "sub rsp, " + std::to_string(n->frame_size) + "\n";
+      ctx->rsp = -n->frame_size;
+      for (int i=0; i < (int)args.size(); i++) {
+        ASTDeclarator *d = args[i]->declarator;
+        int size = type_size(d->type);
+        code += "mov [rbp - " + std::to_string(d->offset) + "], ";
+        code += sized_reg(param_reg_names[i], size) + "\n";
       }
-      generate_sub(n->body, ctx, code);
-      // pop arguments
-      ctx->rsp += (int)name_args.size() * 8;
-      code += "add rsp, " + std::to_string((int)name_args.size() * 8) + "\n";
+      visit(n->body);
+      ctx->rsp = 0;
       ctx->end_scope(); // check rsp
+      if (always_returns(n->body)) return;
       code += "mov rsp, rbp\n";
       code += "pop rbp\n";
       code += "ret\n"; // default return
     }
-    if (typeid(*ast) == typeid(ASTDeclaration)) {
-      std::shared_ptr<ASTDeclaration> n = std::dynamic_pointer_cast<ASTDeclaration>(ast);
-      std::shared_ptr<EvalType> base_type = create_base_type(n->declaration_spec);
-      // sub number of declarators * 8 from rsp
-      code += "sub rsp, " + std::to_string((int)n->declarators.size() * 8) + "\n";
-      for (std::shared_ptr<ASTDeclarator> d: n->declarators) {
-        // all size of vars are 8 byte (64bit) in this l4tc
-        ctx->rsp -= 8;
-        // add vars in function arguments to local vars
-        ctx->add_local_var(std::string(d->op->sv), create_type(d, base_type));
+
+    // locals live in the frame allocated by visit_func_def
+    void visit_declaration(ASTDeclaration *) {}
+
+    // the elif and else chain is walked in a loop, not by recursion
+    void visit_if_stmt(ASTIfStmt *n) {
+      std::vector<int> end_labels;
+      generate_branch(n->cond, n->true_stmt, end_labels);
+      for (ASTElseStmt *e = n->false_stmt; e; e = e->false_stmt) {
+        generate_branch(e->cond, e->true_stmt, end_labels);
+      }
+      for (auto it = end_labels.rbegin(); it != end_labels.rend(); ++it) {
+        code += "L" + std::to_string(*it) + ":\n";
       }
-      return;
-    }
-    if (typeid(*ast) == typeid(ASTIfStmt)) {
-      std::shared_ptr<ASTIfStmt> n = std::dynamic_pointer_cast<ASTIfStmt>(ast);
-      int false_label = label_number++;
-      int end_label = label_number++;
-      generate_sub(n->cond, ctx, code);
-      ctx->rsp += 8;
-      code += "pop r10\n";
-      if (n->cond->is_assignable) code += "mov r10, [r10]\n";
-      code += "cmp r10, 0\n";
-      code += "setnz r10b\n";
-      code += "jz L" + std::to_string(false_label) + "\n";
-      generate_sub(n->true_stmt, ctx, code);
-      code += "jmp L" + std::to_string(end_label) + "\n";
-      code += "L" + std::to_string(false_label) + ":\n";
-      if (n->false_stmt) generate_sub(n->false_stmt, ctx, code);
-      code += "L" + std::to_string(end_label) + ":\n";
     }
-    if (typeid(*ast) == typeid(ASTElseStmt)) {
-      std::shared_ptr<ASTElseStmt> n = std::dynamic_pointer_cast<ASTElseStmt>(ast);
+
+    // cond is null for else
+    void generate_branch(ASTExpr *cond, ASTCompoundStmt *true_stmt, std::vector<int> &end_labels) {
       int false_label = label_number++;
       int end_label = label_number++;
-      if (n->cond) {
-        generate_sub(n->cond, ctx, code);
+      end_labels.push_back(end_label);
+      if (cond && registers) {
+        eval(cond);
+        code += "test r10, r10\n";
+        code += "jz L" + std::to_string(false_label) + "\n";
+      } else if (cond) {
+        visit(cond);
         ctx->rsp += 8;
         code += "pop r10\n";
-        if (n->cond->is_assignable) code += "mov r10, [r10]\n";
+        if (cond->is_assignable) load(code, "r10", cond->eval_type);
         code += "cmp r10, 0\n";
         code += "setnz r10b\n";
         code += "jz L" + std::to_string(false_label) + "\n";
       }
-      generate_sub(n->true_stmt, ctx, code);
-      code += "jmp L" + std::to_string(end_label) + "\n";
+      visit(true_stmt);
+      // else falls through to the end
+      if (cond && !always_returns(true_stmt)) code += "jmp L" + std::to_string(end_label) + "\n";
       code += "L" + std::to_string(false_label) + ":\n";
-      if (n->false_stmt) generate_sub(n->false_stmt, ctx, code);
-      code += "L" + std::to_string(end_label) + ":\n";
     }
-    if (typeid(*ast) == typeid(ASTCompoundStmt)) {
-      std::shared_ptr<ASTCompoundStmt> n = std::dynamic_pointer_cast<ASTCompoundStmt>(ast);
+
+    void visit_comp_stmt(ASTCompoundStmt *n) {
       ctx->start_scope(); // remember rsp value
-      for (std::shared_ptr<AST> stmt: n->items) {
-        if (typeid(*stmt) == typeid(ASTDeclaration)) generate_sub(stmt, ctx, code);
+      for (AST *stmt: n->items) {
+        if (stmt->kind == AST::Declaration) visit(stmt);
       }
-      int saved_rsp = ctx->rsp;
-      for (std::shared_ptr<AST> stmt: n->items) {
-        if (typeid(*stmt) == typeid(ASTDeclaration)) continue;
-        if (typeid(*stmt) == typeid(ASTCompoundStmt)) ctx->start_scope();
-        generate_sub(stmt, ctx, code);
-        if (typeid(*stmt) == typeid(ASTCompoundStmt)) ctx->end_scope();
+      for (AST *stmt: n->items) {
+        if (stmt->kind == AST::Declaration) continue;
+        if (stmt->kind == AST::CompoundStmt) ctx->start_scope();
+        visit(stmt);
+        if (stmt->kind == AST::CompoundStmt) ctx->end_scope();
       }
-      assert(ctx->rsp == saved_rsp);
-      ctx->rsp += ctx->saved_rsp.back() - saved_rsp;
-      code += "add rsp, " + std::to_string(ctx->saved_rsp.back() - saved_rsp) + "\n";
       ctx->end_scope();
-      return;
     }
-    if (typeid(*ast) == typeid(ASTExprStmt)) {
-      std::shared_ptr<ASTExprStmt> n = std::dynamic_pointer_cast<ASTExprStmt>(ast);
-      generate_sub(n->expr, ctx, code);
+
+    void visit_expr_stmt(ASTExprStmt *n) {
+      if (registers) {
+        eval(static_cast<ASTExpr *>(n->expr));
+        return;
+      }
+      visit(n->expr);
       ctx->rsp += 8;
       code += "pop r10\n"; // pop the value that need not be evaluate
-      return;
     }
-    if (typeid(*ast) == typeid(ASTReturnStmt)) {
-      std::shared_ptr<ASTReturnStmt> n = std::dynamic_pointer_cast<ASTReturnStmt>(ast);
-      std::shared_ptr<ASTExpr> expr = std::dynamic_pointer_cast<ASTExpr>(n->expr);
-      generate_sub(expr, ctx, code);
-      ctx->rsp += 8;
-      code += "pop rax\n"; // set return value
-      if (expr->is_assignable) code += "mov rax, [rax]\n";
+
+    void visit_return_stmt(ASTReturnStmt *n) {
+      ASTExpr *expr = static_cast<ASTExpr *>(n->expr);
+      if (registers) {
+        eval(expr);
+        code += "mov rax, r10\n";
+      } else {
+        visit(expr);
+        ctx->rsp += 8;
+        code += "pop rax\n"; // set return value
+        if (expr->is_assignable) load(code, "rax", expr->eval_type);
+      }
+      if (ret_type != expr->eval_type) extend(code, "rax", ret_type);
       code += "mov rsp, rbp\n";
       code += "pop rbp\n";
       code += "ret\n";
-      return;
     }
-    // if (typeid(*ast) == typeid(ASTBreakStmt)) {
+
+    // void visit_break_stmt(ASTBreakStmt *n) {
     //   std::string label = ctx->get_loop().label_break;
     //   // TODO rsp
     //   if (!label.length()) {
@@ -191,9 +219,8 @@ namespace generator {
     //     assert(false);
     //   }
     //   code += "jmp L" + label;
-    //   return;
     // }
-    // if (typeid(*ast) == typeid(ASTContinueStmt)) {
+    // void visit_continue_stmt(ASTContinueStmt *n) {
     //   std::string label = ctx->get_loop().label_continue;
     //   // TODO rsp
     //   if (!label.length()) {
@@ -201,108 +228,68 @@ namespace generator {
     //     assert(false);
     //   }
     //   code += "jmp L" + label;
-    //   return;
     // }
-    if (typeid(*ast) == typeid(ASTAssignExpr)) {
-      std::shared_ptr<ASTAssignExpr> n = std::dynamic_pointer_cast<ASTAssignExpr>(ast);
-      generate_sub(n->right, ctx, code);
-      generate_sub(n->left, ctx, code);
-      if (!n->left->is_assignable) {
-        // TODO error
-        assert(false);
-      }
-      // TODO recursive check for type of pointer, function
-      if (typeid(*(n->left->eval_type)) != typeid(*(n->right->eval_type))) {
-        // TODO error
-        assert(false);
-      }
+
+    void visit_assign_expr(ASTAssignExpr *n) {
+      visit(n->right);
+      visit(n->left);
       code += "pop r10\n";
       code += "pop r11\n";
-      if (n->right->is_assignable) code += "mov r11 [r11]\n";
-      code += "mov [r10], r11\n";
-      // code += "mov r11, [r10]\n";
+      if (n->right->is_assignable) load(code, "r11", n->right->eval_type);
+      int size = type_size(n->left->eval_type);
+      code += "mov [r10], " + sized_reg("r11", size) + "\n";
+      extend(code, "r11", n->left->eval_type); // the value is the one stored
       code += "push r11\n";
       ctx->rsp += 8; // 2 pop 1 push
-      n->eval_type = n->left->eval_type;
-      n->is_assignable = false;
     }
-    // if (typeid(*ast) == typeid(ASTLogicalOrExpr)) {}
-    // if (typeid(*ast) == typeid(ASTLogicalAndExpr)) {}
-    // if (typeid(*ast) == typeid(ASTBitwiseOrExpr)) {}
-    // if (typeid(*ast) == typeid(ASTBitwiseXorExpr)) {}
-    // if (typeid(*ast) == typeid(ASTBitwiseAndExpr)) {}
-    // if (typeid(*ast) == typeid(ASTEqualityExpr)) {}
-    // if (typeid(*ast) == typeid(ASTRelationalExpr)) {}
-    // if (typeid(*ast) == typeid(ASTShiftExpr)) {}
-    if (typeid(*ast) == typeid(ASTAdditiveExpr)) {
-      std::shared_ptr<ASTAdditiveExpr> n = std::dynamic_pointer_cast<ASTAdditiveExpr>(ast);
-      generate_sub(n->left, ctx, code);
-      generate_sub(n->right, ctx, code);
-      if (typeid(*(n->left->eval_type)) != typeid(TypeNum)) {
-        // TODO error
-        assert(false);
-      }
-      if (typeid(*(n->right->eval_type)) != typeid(TypeNum)) {
-        // TODO error
-        assert(false);
-      }
+
+    // void visit_logical_or_expr(ASTLogicalOrExpr *n) {}
+    // void visit_logical_and_expr(ASTLogicalAndExpr *n) {}
+    // void visit_bitwise_or_expr(ASTBitwiseOrExpr *n) {}
+    // void visit_bitwise_xor_expr(ASTBitwiseXorExpr *n) {}
+    // void visit_bitwise_and_expr(ASTBitwiseAndExpr *n) {}
+    // void visit_equality_expr(ASTEqualityExpr *n) {}
+    // void visit_relational_expr(ASTRelationalExpr *n) {}
+    // void visit_shift_expr(ASTShiftExpr *n) {}
+
+    void visit_additive_expr(ASTAdditiveExpr *n) {
+      visit(n->left);
+      visit(n->right);
       code += "pop r11\n";
       code += "pop r10\n";
-      if (n->left->is_assignable) code += "mov r10, [r10]\n";
-      if (n->right->is_assignable) code += "mov r11, [r11]\n";
-      if (n->op->sv == "+") code += "add r10, r11\n";
+      if (n->left->is_assignable) load(code, "r10", n->left->eval_type);
+      if (n->right->is_assignable) load(code, "r11", n->right->eval_type);
+      if (n->op.type == PlusTok) code += "add r10, r11\n";
       else code += "sub r10, r11\n";
       code += "push r10\n";
       ctx->rsp += 8; // 2 pop and 1 push
-      n->eval_type = n->left->eval_type;
-      n->is_assignable = false;
     }
-    if (typeid(*ast) == typeid(ASTMultiplicativeExpr)) {
-      std::shared_ptr<ASTMultiplicativeExpr> n = std::dynamic_pointer_cast<ASTMultiplicativeExpr>(ast);
-      generate_sub(n->left, ctx, code);
-      generate_sub(n->right, ctx, code);
-      if (typeid(*(n->left->eval_type)) != typeid(TypeNum)) {
-        // TODO error
-        assert(false);
-      }
-      if (typeid(*(n->right->eval_type)) != typeid(TypeNum)) {
-        // TODO error
-        assert(false);
-      }
+
+    void visit_multiplicative_expr(ASTMultiplicativeExpr *n) {
+      visit(n->left);
+      visit(n->right);
       code += "pop r11\n";
       code += "pop r10\n";
-      if (n->left->is_assignable) code += "mov r10, [r10]\n";
-      if (n->right->is_assignable) code += "mov r11, [r11]\n";
-      code += "imul r10, r11\n";
+      if (n->left->is_assignable) load(code, "r10", n->left->eval_type);
+      if (n->right->is_assignable) load(code, "r11", n->right->eval_type);
+      if (n->op.type == StarTok) {
+        code += "imul r10, r11\n";
+      } else {
+        code += "mov rax, r10\n";
+        code += "cqo\n";
+        code += "idiv r11\n";
+        code += n->op.type == SlashTok ? "mov r10, rax\n" : "mov r10, rdx\n";
+      }
       code += "push r10\n";
       ctx->rsp += 8; // 2 pop and 1 push
-      n->eval_type = n->left->eval_type;
-      n->is_assignable = false;
     }
-    if (typeid(*ast) == typeid(ASTFuncCallExpr)) {
-      std::shared_ptr<ASTFuncCallExpr> n = std::dynamic_pointer_cast<ASTFuncCallExpr>(ast);
-      generate_sub(n->primary, ctx, code);
-      if (typeid(*(n->primary->eval_type)) != typeid(TypeFunc)) {
-        // TODO error
-        assert(false);
-      }
-      std::shared_ptr<TypeFunc> tf = std::dynamic_pointer_cast<TypeFunc>(n->primary->eval_type);
-      if (n->args.size() != tf->type_args.size()) {
-        // TODO error
-        assert(false);
-      }
-      for (int i=0; i < (int)n->args.size(); i++) {
-        generate_sub(n->args[i], ctx, code);
-        if (typeid(*(n->args[i]->eval_type)) != typeid(*(tf->type_args[i]))) {
-          // TODO error
-          assert(false);
-        }
-      }
+
+    void visit_func_call_expr(ASTFuncCallExpr *n) {
+      visit(n->primary);
+      for (ASTExpr *arg: n->args) visit(arg);
       for (int i=(int)n->args.size()-1; i >= 0; i--) {
         code += "pop " + param_reg_names[i] + "\n";
-        if (n->args[i]->is_assignable) {
-          code += "mov " + param_reg_names[i] + ", [" + param_reg_names[i] +"]\n";
-        }
+        if (n->args[i]->is_assignable) load(code, param_reg_names[i], n->args[i]->eval_type);
       }
       ctx->rsp += (int)n->args.size() * 8;
       code += "pop rax\n";
@@ -311,54 +298,305 @@ namespace generator {
       code += "call rax\n";
       if (!ctx->is_rsp_aligned()) code += "add rsp, 8\n";
       code += "push rax\n";
-      n->eval_type = tf->ret_type;
-      n->is_assignable = false;
-      return;
     }
-    if (typeid(*ast) == typeid(ASTPrimaryExpr)) {
-      std::shared_ptr<ASTPrimaryExpr> n = std::dynamic_pointer_cast<ASTPrimaryExpr>(ast);
-      generate_sub(n->expr, ctx, code);
-      n->eval_type = n->expr->eval_type;
-      n->is_assignable = n->expr->is_assignable;
-      return;
+
+    void visit_primary_expr(ASTPrimaryExpr *n) {
+      visit(n->expr);
+    }
+
+    // resolved by check
+    void visit_simple_expr(ASTSimpleExpr *n) {
+      if (n->op.type == NumberConstant) {
+        code += "mov r10, " + std::string(n->op.sv) + "\n";
+      } else if (n->is_global) {
+        std::string name(n->op.sv);
+        code += ".global " + name + "\n";
+        code += "mov r10, [rip + " + name + "@GOTPCREL]\n";
+      } else {
+        code += "lea r10, [rbp - " + std::to_string(n->offset) + "]\n";
+      }
+      code += "push r10\n";
+      ctx->rsp -= 8;
     }
-    if (typeid(*ast) == typeid(ASTSimpleExpr)) {
-      std::shared_ptr<ASTSimpleExpr> n = std::dynamic_pointer_cast<ASTSimpleExpr>(ast);
-      if (n->op->type == Ident) {
-        std::shared_ptr<LocalVar> lvi = ctx->get_local_var(n->op->sv);
-        if (lvi) {
-          code += "lea r10, [rbp - " + std::to_string(lvi->offset) + "]\n";
-          code += "push r10\n";
-          ctx->rsp -= 8;
-          n->eval_type = lvi->type;
-          n->is_assignable = true;
-          return;
+
+    // with registers, an expression is evaluated into regs: of the two
+    // operands the one that needs more registers goes first when that
+    // cannot be told apart, and regs are spilled to the stack only when
+    // the tree needs more than there are; a variable operand is read
+    // when its operator runs, as on the stack
+    void eval(ASTExpr *n) {
+      label(n);
+      gen(n, 0);
+    }
+
+    static ASTExpr *strip(ASTExpr *n) {
+      while (n->kind == AST::PrimaryExpr) n = static_cast<ASTPrimaryExpr *>(n)->expr;
+      return n;
+    }
+
+    static bool is_div(ASTExpr *n) {
+      return n->kind == AST::MultiplicativeExpr && static_cast<ASTMultiplicativeExpr *>(n)->op.type != StarTok;
+    }
+
+    // a leaf that add, sub and imul take as it is, without a register
+    static bool is_operand(ASTExpr *n) {
+      n = strip(n);
+      if (n->kind != AST::SimpleExpr) return false;
+      ASTSimpleExpr *e = static_cast<ASTSimpleExpr *>(n);
+      if (e->op.type == NumberConstant) {
+        int64_t value = number_value(e->op);
+        return value >= INT32_MIN && value <= INT32_MAX;
+      }
+      return !e->is_global && type_size(e->eval_type) == 8;
+    }
+
+    std::string operand(ASTExpr *n) {
+      ASTSimpleExpr *e = static_cast<ASTSimpleExpr *>(strip(n));
+      if (e->op.type == NumberConstant) return std::to_string(number_value(e->op));
+      return "qword ptr [rbp - " + std::to_string(e->offset) + "]";
+    }
+
+    void label(ASTExpr *n) {
+      switch (n->kind) {
+      case AST::PrimaryExpr: {
+        ASTExpr *e = static_cast<ASTPrimaryExpr *>(n)->expr;
+        label(e);
+        n->num_regs = e->num_regs;
+        n->has_effects = e->has_effects;
+        break;
+      }
+      case AST::SimpleExpr:
+        n->num_regs = 1;
+        n->has_effects = false;
+        break;
+      case AST::AssignExpr:
+        label(n->right);
+        n->num_regs = n->right->num_regs;
+        n->has_effects = true;
+        break;
+      case AST::FuncCallExpr: {
+        // the registers in use are saved around a call
+        ASTFuncCallExpr *c = static_cast<ASTFuncCallExpr *>(n);
+        label(c->primary);
+        for (ASTExpr *arg: c->args) label(arg);
+        n->num_regs = 1;
+        n->has_effects = true;
+        break;
+      }
+      default: {
+        label(n->left);
+        label(n->right);
+        int l = n->left->num_regs;
+        int r = is_operand(n->right) && !is_div(n) ? 0 : n->right->num_regs;
+        n->num_regs = l == r ? l + 1 : std::max(l, r);
+        n->has_effects = n->left->has_effects || n->right->has_effects;
+        break;
+      }
+      }
+    }
+
+    void push(const std::string &reg) {
+      code += "push " + reg + "\n";
+      ctx->rsp -= 8;
+    }
+
+    void pop(const std::string &reg) {
+      code += "pop " + reg + "\n";
+      ctx->rsp += 8;
+    }
+
+    // the result goes to regs[k], regs[k + 1] and on are free
+    void gen(ASTExpr *n, int k) {
+      n = strip(n);
+      switch (n->kind) {
+      case AST::SimpleExpr:
+        gen_leaf(static_cast<ASTSimpleExpr *>(n), regs[k]);
+        break;
+      case AST::AssignExpr:
+        gen_assign(static_cast<ASTAssignExpr *>(n), k);
+        break;
+      case AST::FuncCallExpr:
+        gen_call(static_cast<ASTFuncCallExpr *>(n), k);
+        break;
+      default:
+        gen_binary(n, k);
+        break;
+      }
+    }
+
+    void gen_leaf(ASTSimpleExpr *n, const std::string &reg) {
+      if (n->op.type == NumberConstant) {
+        code += "mov " + reg + ", " + std::string(n->op.sv) + "\n";
+      } else if (n->is_global) {
+        std::string name(n->op.sv);
+        code += ".global " + name + "\n";
+        code += "mov " + reg + ", [rip + " + name + "@GOTPCREL]\n";
+        if (n->is_assignable) load(code, reg, n->eval_type);
+      } else {
+        load(code, reg, "rbp - " + std::to_string(n->offset), n->eval_type);
+      }
+    }
+
+    // the operator of n on left and right into dst, which is one of them
+    void combine(ASTExpr *n, const std::string &left, const std::string &right, const std::string &dst) {
+      if (is_div(n)) {
+        if (left != "rax") code += "mov rax, " + left + "\n";
+        code += "cqo\n";
+        code += "idiv " + right + "\n";
+        code += "mov " + dst + (static_cast<ASTMultiplicativeExpr *>(n)->op.type == SlashTok ? ", rax\n" : ", rdx\n");
+        return;
+      }
+      bool sub = n->kind == AST::AdditiveExpr && static_cast<ASTAdditiveExpr *>(n)->op.type == MinusTok;
+      std::string ins = n->kind == AST::MultiplicativeExpr ? "imul " : sub ? "sub " : "add ";
+      if (dst == left) {
+        code += ins + left + ", " + right + "\n";
+      } else if (!sub) {
+        code += ins + dst + ", " + left + "\n";
+      } else {
+        code += "sub " + left + ", " + right + "\n";
+        code += "mov " + dst + ", " + left + "\n";
+      }
+    }
+
+    void gen_binary(ASTExpr *n, int k) {
+      ASTExpr *l = n->left, *r = n->right;
+      int avail = num_regs - k;
+      const std::string &dst = regs[k];
+      if (!is_div(n) && is_operand(r)) {
+        gen(l, k);
+        combine(n, dst, operand(r), dst);
+      } else if (strip(l)->kind == AST::SimpleExpr && r->has_effects) {
+        // l is read after r runs
+        gen(r, k);
+        std::string t = avail > 1 ? regs[k + 1] : "rax";
+        gen_leaf(static_cast<ASTSimpleExpr *>(strip(l)), t);
+        combine(n, t, dst, dst);
+      } else if (!l->has_effects && !r->has_effects && r->num_regs > l->num_regs) {
+        gen(r, k);
+        if (l->num_regs < avail) {
+          gen(l, k + 1);
+          combine(n, regs[k + 1], dst, dst);
+        } else {
+          push(dst);
+          gen(l, k);
+          combine(n, dst, "qword ptr [rsp]", dst);
+          code += "add rsp, 8\n";
+          ctx->rsp += 8;
         }
-        std::shared_ptr<GlobalVar> gvi = ctx->get_global_var(n->op->sv);
-        if (gvi) {
-          code += ".global " + gvi->name + "\n";
-          code += "mov r10, [rip + " + gvi->name + "@GOTPCREL]\n";
-          code += "push r10\n";
-          ctx->rsp -= 8;
-          n->eval_type = gvi->type;
-          n->is_assignable = typeid(*(n->eval_type)) != typeid(TypeFunc);
-          return;
+      } else {
+        gen(l, k);
+        if (r->num_regs < avail) {
+          gen(r, k + 1);
+          combine(n, dst, regs[k + 1], dst);
+        } else {
+          push(dst);
+          gen(r, k);
+          pop("rax");
+          combine(n, "rax", dst, dst);
         }
-      } else if (n->op->type == NumberConstant) {
-        code += "mov r10, " + std::string(n->op->sv) + "\n";
-        code += "push r10\n";
-        ctx->rsp -= 8;
-        n->eval_type = std::make_shared<TypeNum>();
-        n->is_assignable = false;
-        return;
       }
     }
-  }
 
-  std::string generate(std::shared_ptr<AST> ast) {
+    void gen_assign(ASTAssignExpr *n, int k) {
+      ASTSimpleExpr *target = static_cast<ASTSimpleExpr *>(strip(n->left));
+      gen(n->right, k);
+      std::string value = sized_reg(regs[k], type_size(n->left->eval_type));
+      if (target->is_global) {
+        std::string name(target->op.sv);
+        code += ".global " + name + "\n";
+        code += "mov rax, [rip + " + name + "@GOTPCREL]\n";
+        code += "mov [rax], " + value + "\n";
+      } else {
+        code += "mov [rbp - " + std::to_string(target->offset) + "], " + value + "\n";
+      }
+      extend(code, regs[k], n->left->eval_type); // the value is the one stored
+    }
+
+    // regs[i] to the i-th argument register for each i < n, all at once
+    void move_args(int n) {
+      std::vector<std::pair<std::string, std::string>> moves; // to, from
+      for (int i = 0; i < n; i++) {
+        if (regs[i] != param_reg_names[i]) moves.push_back({param_reg_names[i], regs[i]});
+      }
+      while (!moves.empty()) {
+        bool progress = false;
+        for (size_t i = 0; i < moves.size();) {
+          bool read = false;
+          for (auto &m: moves) read |= m.second == moves[i].first;
+          if (read) {
+            i++;
+            continue;
+          }
+          code += "mov " + moves[i].first + ", " + moves[i].second + "\n";
+          moves.erase(moves.begin() + i);
+          progress = true;
+        }
+        if (progress) continue;
+        // a cycle, one destination is read from rax instead
+        std::string to = moves[0].first;
+        code += "mov rax, " + to + "\n";
+        for (auto &m: moves) {
+          if (m.second == to) m.second = "rax";
+        }
+      }
+    }
+
+    void gen_call(ASTFuncCallExpr *n, int k) {
+      // the registers in use survive the call on the stack
+      for (int i = 0; i < k; i++) push(regs[i]);
+      ASTExpr *primary = strip(n->primary);
+      ASTSimpleExpr *callee = primary->kind == AST::SimpleExpr ? static_cast<ASTSimpleExpr *>(primary) : nullptr;
+      if (!callee) {
+        gen(primary, 0);
+        push(regs[0]);
+      }
+      int num_args = n->args.size();
+      bool in_regs = true;
+      for (int i = 0; i < num_args; i++) {
+        in_regs &= !n->args[i]->has_effects && n->args[i]->num_regs <= num_regs - i;
+      }
+      if (in_regs) {
+        for (int i = 0; i < num_args; i++) gen(n->args[i], i);
+        move_args(num_args);
+      } else {
+        // as on the stack, a variable is read after all args run
+        for (ASTExpr *arg: n->args) {
+          ASTSimpleExpr *e = static_cast<ASTSimpleExpr *>(strip(arg));
+          if (e->kind == AST::SimpleExpr && e->is_assignable && !e->is_global) {
+            code += "lea r10, [rbp - " + std::to_string(e->offset) + "]\n";
+          } else if (e->kind == AST::SimpleExpr && e->is_assignable) {
+            code += "mov r10, [rip + " + std::string(e->op.sv) + "@GOTPCREL]\n";
+          } else {
+            gen(arg, 0);
+          }
+          push(regs[0]);
+        }
+        for (int i = num_args - 1; i >= 0; i--) {
+          pop(param_reg_names[i]);
+          if (n->args[i]->is_assignable) load(code, param_reg_names[i], n->args[i]->eval_type);
+        }
+      }
+      bool direct = callee && callee->is_global && !callee->is_assignable;
+      if (!callee) pop("rax");
+      else if (!direct) gen_leaf(callee, "rax");
+      // rsp needs to be aligned when call
+      if (!ctx->is_rsp_aligned()) code += "sub rsp, 8\n";
+      if (direct) {
+        std::string name(callee->op.sv);
+        code += ".global " + name + "\n";
+        code += "call [rip + " + name + "@GOTPCREL]\n";
+      } else {
+        code += "call rax\n";
+      }
+      if (!ctx->is_rsp_aligned()) code += "add rsp, 8\n";
+      code += "mov " + regs[k] + ", rax\n";
+      for (int i = k - 1; i >= 0; i--) pop(regs[i]);
+    }
+  };
+
+  std::string generate(AST *ast, bool registers) {
     std::string ret;
-    std::shared_ptr<Context> context = std::make_shared<Context>();
-    generate_sub(ast, context, ret);
+    Generator(ret, registers).visit(ast);
     return ret;
   }
-}
\ No newline at end of file
+}
@@ -7,15 +7,25 @@
 namespace generator {
   using namespace tokenizer;
   using namespace parser;
+  // types are interned by TypeContext, so two types are
+  // the same exactly when their pointers are equal
   class EvalType {
     public:
-    EvalType() {}
-    virtual ~EvalType() = default;
+    enum Kind {
+      Num,
+      Pointer,
+      Func,
+    };
+    Kind kind;
+    EvalType(Kind k) : kind(k) {}
   };
 
+  // integers, num is i64
   class TypeNum : public EvalType {
     public:
-    TypeNum() : EvalType() {}
+    int size; // in bytes, 1, 2, 4 or 8
+    bool is_signed;
+    TypeNum(int s, bool sg) : EvalType(Num), size(s), is_signed(sg) {}
   };
 
   // class TypeVoid : public EvalType {
@@ -25,16 +35,57 @@ namespace generator {
 
   class TypePointer : public EvalType {
     public:
-    std::shared_ptr<EvalType> pointer_of;
-    TypePointer(std::shared_ptr<EvalType> of) : EvalType(), pointer_of(of) {}
+    EvalType *pointer_of;
+    TypePointer(EvalType *of) : EvalType(Pointer), pointer_of(of) {}
   };
 
   class TypeFunc : public EvalType {
     public:
-    std::vector<std::shared_ptr<EvalType>> type_args;
-    std::shared_ptr<EvalType> ret_type;
-    TypeFunc(std::vector<std::shared_ptr<EvalType>> &ta, std::shared_ptr<EvalType> rt)
-    : type_args(ta), ret_type(rt) {}
+    std::vector<EvalType *> type_args;
+    EvalType *ret_type;
+    TypeFunc(std::vector<EvalType *> &ta, EvalType *rt)
+    : EvalType(Func), type_args(ta), ret_type(rt) {}
+  };
+
+  // owns one instance of each distinct type
+  // the parts of a type are interned before it, so comparing
+  // them by pointer compares the whole structure
+  class TypeContext {
+    public:
+    std::deque<TypeNum> num_types; // by log2 of size, then signed and unsigned
+    std::deque<TypePointer> pointer_types;
+    std::deque<TypeFunc> func_types;
+    std::map<EvalType *, TypePointer *> pointers;
+    std::map<std::pair<std::vector<EvalType *>, EvalType *>, TypeFunc *> funcs;
+
+    TypeContext() {
+      for (int size = 1; size <= 8; size *= 2) {
+        num_types.emplace_back(size, true);
+        num_types.emplace_back(size, false);
+      }
+    }
+    TypeContext(const TypeContext &) = delete;
+    TypeContext &operator=(const TypeContext &) = delete;
+
+    EvalType *integer(int size, bool is_signed) {
+      return &num_types[__builtin_ctz(size) * 2 + !is_signed];
+    }
+
+    EvalType *num() {
+      return integer(8, true);
+    }
+
+    EvalType *pointer(EvalType *of) {
+      TypePointer *&p = pointers[of];
+      if (!p) p = &pointer_types.emplace_back(of);
+      return p;
+    }
+
+    EvalType *func(std::vector<EvalType *> &type_args, EvalType *ret_type) {
+      TypeFunc *&f = funcs[{type_args, ret_type}];
+      if (!f) f = &func_types.emplace_back(type_args, ret_type);
+      return f;
+    }
   };
 
   // class LoopInfo {
@@ -52,65 +103,77 @@ namespace generator {
   //   }
   // };
 
-  class GlobalVar {
-    public:
-    std::string name;
-    std::shared_ptr<EvalType> type;
-    GlobalVar(std::string n, std::shared_ptr<EvalType> t) : name(n), type(t) {}
-  };
+  // bytes of a variable of type t, which is also its alignment
+  inline int type_size(EvalType *t) {
+    return t && t->kind == EvalType::Num ? static_cast<TypeNum *>(t)->size : 8;
+  }
 
-  class LocalVar {
+  // a variable bound to an interned name
+  class Var {
     public:
-    int offset;
-    std::shared_ptr<EvalType> type;
-    LocalVar(int o, std::shared_ptr<EvalType> t) : offset(o), type(t) {}
+    int depth; // 0 for globals, the scope depth for locals, -1 if unbound
+    // its type is null after an error in the declaration
+    ASTDeclarator *decl;
+    Var() : depth(-1), decl(nullptr) {}
+    Var(int d, ASTDeclarator *dc) : depth(d), decl(dc) {}
   };
 
-  class Context {
+  // names visible at a point of the semantic pass
+  class SymbolTable {
     public:
-    int rsp;
-    std::vector<int> saved_rsp;
-    std::vector<std::map<std::string, std::shared_ptr<LocalVar>>> scopes_local_vars;
-    std::map<std::string, std::shared_ptr<GlobalVar>> global_vars;
+    // the binding visible now for each name id
+    std::vector<Var> vars;
+    // bindings shadowed by open scopes, restored when they end
+    std::vector<std::pair<uint32_t, Var>> undo_log;
+    std::vector<size_t> saved_undo_log;
 
-    Context() : rsp(0), saved_rsp() {}
+    SymbolTable(size_t num_names) : vars(num_names) {}
 
-    void add_global_var(std::string key, std::shared_ptr<EvalType> type) {
-      global_vars.insert({key, std::make_shared<GlobalVar>(key, type)});
+    int depth() {
+      return saved_undo_log.size();
     }
 
-    void add_local_var(std::string key, std::shared_ptr<EvalType> type) {
-      scopes_local_vars.back().insert(
-        {key, std::make_shared<LocalVar>(-rsp, type)}
-      );
+    // the first declaration in a scope wins
+    void add_var(ASTDeclarator *decl) {
+      Var &cur = vars[decl->op.id];
+      if (cur.depth == depth()) return;
+      if (depth()) undo_log.push_back({decl->op.id, cur});
+      cur = Var(depth(), decl);
     }
 
-    std::shared_ptr<GlobalVar> get_global_var(std::string_view key) {
-      auto it = global_vars.find(std::string(key));
-      if (it == global_vars.end()) return nullptr;
-      return it->second;
+    // null if the name is not declared
+    Var *get_var(Token &name) {
+      Var &v = vars[name.id];
+      return v.depth >= 0 ? &v : nullptr;
     }
 
-    std::shared_ptr<LocalVar> get_local_var(std::string_view key) {
-      for (int i=(int)scopes_local_vars.size()-1; i >= 0; i--) {
-        auto it = scopes_local_vars[i].find(std::string(key));
-        if (it == scopes_local_vars[i].end()) continue;
-        return it->second;
+    void start_scope() {
+      saved_undo_log.push_back(undo_log.size());
+    }
+
+    void end_scope() {
+      while (undo_log.size() > saved_undo_log.back()) {
+        vars[undo_log.back().first] = undo_log.back().second;
+        undo_log.pop_back();
       }
-      return nullptr;
+      saved_undo_log.pop_back();
     }
+  };
+
+  class Context {
+    public:
+    int rsp;
+    std::vector<int> saved_rsp;
+
+    Context() : rsp(0), saved_rsp() {}
 
     void start_scope() {
       saved_rsp.push_back(rsp);
-      scopes_local_vars.push_back(
-        std::map<std::string, std::shared_ptr<LocalVar>>()
-      );
     }
 
     void end_scope() {
       assert(saved_rsp.back() == rsp);
       saved_rsp.pop_back();
-      scopes_local_vars.pop_back();
     }
 
     // LoopInfo get_loop() {
@@ -121,6 +184,62 @@ namespace generator {
       return !(rsp & 0xF);
     }
   };
-  std::string generate(std::shared_ptr<AST> ast);
+
+  // an error found by the semantic pass
+  class Diagnostic {
+    public:
+    Token token;
+    std::string message;
+    Diagnostic(Token &t, std::string m) : token(t), message(m) {}
+    std::string get_error_string(LineTable &lines);
+  };
+
+  // semantic.cpp
+  // resolves names and types of the tree in place for generate
+  // false if there is an error, all errors are appended to diags
+  // types of the tree are owned by types
+  bool check(AST *ast, NameTable &names, TypeContext &types, std::vector<Diagnostic> &diags);
+  // spelled as in declarations
+  std::string type_name(EvalType *t);
+
+  // fold.cpp
+  // the value of a NumberConstant, which has a sign once folded
+  int64_t number_value(Token &t);
+  // the value of n if it is made of constants only, false if it is not
+  // or if computing it would trap
+  bool constant_value(ASTExpr *n, int64_t &value);
+  // folds constant exprs, simplifies x * 1, x + 0, x * 0, x - x and the
+  // like and drops the branches of if whose conditions are constant,
+  // in place; new nodes are allocated from arena
+  // ast must have passed check
+  void fold(AST *ast, Arena &arena);
+
+  // dce.cpp
+  // whether control never reaches the end of the statement n
+  bool always_returns(AST *n);
+  // removes statements after a return, stores to locals that are not
+  // read again and statements whose values are not used and that have
+  // no effects; ast must have passed check
+  void remove_dead_code(AST *ast);
+
+  // generator.cpp
+  // ast must have passed check
+  // registers: evaluate expressions in registers in Sethi-Ullman order
+  // instead of on the stack
+  std::string generate(AST *ast, bool registers);
+  // x86 helpers shared with the IR emitter
+  extern const std::string param_reg_names[6];
+  // the low size bytes of a 64-bit register, "al" for "rax" and 1
+  const std::string &sized_reg(const std::string &reg, int size);
+  // load the value of type t at the address in reg into reg
+  void load(std::string &code, const std::string &reg, EvalType *t);
+  // or at addr, which is a register or like "rbp - 8"
+  void load(std::string &code, const std::string &reg, const std::string &addr, EvalType *t);
+  // truncate the value in reg to type t, then extend it back to 64 bits
+  void extend(std::string &code, const std::string &reg, EvalType *t);
+  // the initializer of the global d as it is stored, truncated to its type
+  int64_t init_value(ASTDeclarator *d);
+  // the global d in .data, d must have an initializer
+  void define_global(std::string &code, ASTDeclarator *d);
 }
 #endif
\ No newline at end of file
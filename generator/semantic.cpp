@@ -0,0 +1,359 @@
+#include "./generator.hpp"
+
+namespace generator {
+  std::string type_name(EvalType *t) {
+    if (!t) return "?";
+    switch (t->kind) {
+    case EvalType::Num: {
+      TypeNum *tn = static_cast<TypeNum *>(t);
+      if (tn->size == 8 && tn->is_signed) return "num";
+      return (tn->is_signed ? "i" : "u") + std::to_string(tn->size * 8);
+    }
+    case EvalType::Pointer:
+      return type_name(static_cast<TypePointer *>(t)->pointer_of) + "*";
+    case EvalType::Func: {
+      TypeFunc *tf = static_cast<TypeFunc *>(t);
+      std::string ret = "funcp (";
+      for (int i = 0; i < (int)tf->type_args.size(); i++) {
+        ret += (i ? ", " : "") + type_name(tf->type_args[i]);
+      }
+      return ret + ") -> " + type_name(tf->ret_type);
+    }
+    }
+    return "?";
+  }
+
+  // the leftmost token of an expression, where its errors are reported
+  Token &first_token(ASTExpr *n) {
+    while (1) {
+      switch (n->kind) {
+      case AST::SimpleExpr:
+        return static_cast<ASTSimpleExpr *>(n)->op;
+      case AST::PrimaryExpr:
+        n = static_cast<ASTPrimaryExpr *>(n)->expr;
+        break;
+      case AST::FuncCallExpr:
+        n = static_cast<ASTFuncCallExpr *>(n)->primary;
+        break;
+      default:
+        n = n->left;
+        break;
+      }
+    }
+  }
+
+  // integers convert to each other implicitly
+  bool is_convertible(EvalType *to, EvalType *from) {
+    return to == from || (to->kind == EvalType::Num && from->kind == EvalType::Num);
+  }
+
+  // resolves every identifier to a frame slot or a global, lays out
+  // the frame of each function and sets eval_type and is_assignable
+  // of every expr
+  // a null eval_type marks an expr whose error is already reported,
+  // so one mistake does not cascade into more errors
+  class Checker : public Visitor<Checker> {
+    public:
+    SymbolTable symbols;
+    std::vector<Diagnostic> &diags;
+    // arguments and locals of the function being checked,
+    // and the references to them whose offsets are not known yet
+    std::vector<ASTDeclarator *> frame_slots;
+    std::vector<std::pair<ASTSimpleExpr *, ASTDeclarator *>> local_refs;
+    EvalType *ret_type; // of the function being checked
+    TypeContext &types;
+    Checker(NameTable &names, TypeContext &t, std::vector<Diagnostic> &d)
+    : symbols(names.size()), diags(d), ret_type(nullptr), types(t) {}
+
+    void error(Token &t, std::string message) {
+      diags.emplace_back(t, message);
+    }
+
+    EvalType *create_base_type(ASTTypeSpec *n) {
+      // TODO static, const
+      if (n->op.type == KwNum) return types.num();
+      if (n->op.type == KwInt) {
+        // i8 ... u64
+        int bits = std::stoi(std::string(n->op.sv.substr(1)));
+        return types.integer(bits / 8, n->op.sv[0] == 'i');
+      }
+      error(n->op, "type `" + std::string(n->op.sv) + "` is not supported yet");
+      return nullptr;
+    }
+
+    EvalType *create_type(ASTDeclarator *, EvalType *base_type) {
+      // TODO: pointer
+      return base_type;
+    }
+
+    TypeFunc *create_func_type(ASTFuncDeclaration *fd) {
+      std::vector<EvalType *> type_args;
+      for (ASTSimpleDeclaration *d: fd->declarator->args) {
+        type_args.push_back(
+          create_type(d->declarator, create_base_type(d->type_spec))
+        );
+      }
+      EvalType *ret_type = create_type(
+        fd->declarator->declarator,
+        create_base_type(fd->type_spec)
+      );
+      return static_cast<TypeFunc *>(types.func(type_args, ret_type));
+    }
+
+    void add_var(ASTDeclarator *d, EvalType *type) {
+      d->type = type;
+      symbols.add_var(d);
+    }
+
+    void add_local_var(ASTDeclarator *d, EvalType *type) {
+      add_var(d, type);
+      frame_slots.push_back(d);
+    }
+
+    // slots sorted by size, which is their alignment, pack without padding
+    // rsp stays a multiple of 8 below them
+    void layout_frame(ASTFuncDef *n) {
+      std::stable_sort(
+        frame_slots.begin(), frame_slots.end(),
+        [](ASTDeclarator *a, ASTDeclarator *b) { return type_size(a->type) > type_size(b->type); }
+      );
+      int size = 0;
+      for (ASTDeclarator *d: frame_slots) {
+        size += type_size(d->type);
+        d->offset = size;
+      }
+      n->frame_size = (size + 7) & ~7;
+      for (auto &ref: local_refs) ref.first->offset = ref.second->offset;
+      frame_slots.clear();
+      local_refs.clear();
+    }
+
+    void visit_translation_unit(ASTTranslationUnit *n) {
+      for (AST *d: n->external_declarations) visit(d);
+    }
+
+    void visit_external_declaration(ASTExternalDeclaration *n) {
+      EvalType *base_type = create_base_type(n->declaration_spec);
+      for (ASTDeclarator *d: n->declarators) {
+        EvalType *type = create_type(d, base_type);
+        if (d->init) check_init(d->init, type);
+        add_var(d, type);
+      }
+    }
+
+    // a global is initialized in .data, so only with a constant
+    void check_init(ASTExpr *init, EvalType *type) {
+      visit(init);
+      if (!init->eval_type || !type) return;
+      int64_t value;
+      if (!is_convertible(type, init->eval_type)) {
+        error(
+          first_token(init),
+          "initializing `" + type_name(type) + "` with `" + type_name(init->eval_type) + "`"
+        );
+      } else if (!constant_value(init, value)) {
+        error(first_token(init), "the initializer of a global is not a constant");
+      }
+    }
+
+    void visit_func_def(ASTFuncDef *n) {
+      ASTFuncDeclaration *fd = n->declaration;
+      Token &name = fd->declarator->declarator->op;
+      TypeFunc *tf = create_func_type(fd);
+      std::vector<ASTSimpleDeclaration *> &args = fd->declarator->args;
+      if (args.size() > 6) {
+        // arguments are only passed in the 6 registers of the SysV ABI
+        error(name, "a function takes at most 6 arguments");
+      }
+      add_var(fd->declarator->declarator, tf);
+      symbols.start_scope();
+      for (int i = 0; i < (int)args.size(); i++) {
+        add_local_var(args[i]->declarator, tf->type_args[i]);
+      }
+      ret_type = tf->ret_type;
+      visit(n->body);
+      symbols.end_scope();
+      layout_frame(n);
+    }
+
+    void visit_declaration(ASTDeclaration *n) {
+      EvalType *base_type = create_base_type(n->declaration_spec);
+      for (ASTDeclarator *d: n->declarators) {
+        add_local_var(d, create_type(d, base_type));
+      }
+    }
+
+    // declarations of a block are in scope in all of its statements
+    void visit_comp_stmt(ASTCompoundStmt *n) {
+      symbols.start_scope();
+      for (AST *item: n->items) {
+        if (item->kind == AST::Declaration) visit(item);
+      }
+      for (AST *item: n->items) {
+        if (item->kind != AST::Declaration) visit(item);
+      }
+      symbols.end_scope();
+    }
+
+    void visit_if_stmt(ASTIfStmt *n) {
+      visit(n->cond);
+      visit(n->true_stmt);
+      for (ASTElseStmt *e = n->false_stmt; e; e = e->false_stmt) {
+        if (e->cond) visit(e->cond);
+        visit(e->true_stmt);
+      }
+    }
+
+    void visit_expr_stmt(ASTExprStmt *n) {
+      visit(n->expr);
+    }
+
+    void visit_return_stmt(ASTReturnStmt *n) {
+      ASTExpr *expr = static_cast<ASTExpr *>(n->expr);
+      visit(expr);
+      if (expr->eval_type && ret_type && !is_convertible(ret_type, expr->eval_type)) {
+        error(
+          first_token(expr),
+          "returning `" + type_name(expr->eval_type) +
+          "` from a function returning `" + type_name(ret_type) + "`"
+        );
+      }
+    }
+
+    void visit_break_stmt(ASTBreakStmt *n) {
+      error(n->op, "`break` outside of a loop");
+    }
+
+    void visit_continue_stmt(ASTContinueStmt *n) {
+      error(n->op, "`continue` outside of a loop");
+    }
+
+    void visit_assign_expr(ASTAssignExpr *n) {
+      visit(n->left);
+      visit(n->right);
+      n->eval_type = n->left->eval_type;
+      n->is_assignable = false;
+      if (!n->left->eval_type || !n->right->eval_type) return;
+      if (!n->left->is_assignable) {
+        error(first_token(n->left), "the left side of `:` is not assignable");
+      } else if (!is_convertible(n->left->eval_type, n->right->eval_type)) {
+        error(
+          n->op,
+          "assigning `" + type_name(n->right->eval_type) +
+          "` to `" + type_name(n->left->eval_type) + "`"
+        );
+      }
+    }
+
+    // arithmetic on integers is done in 64 bits
+    void check_num_operands(ASTExpr *n, Token &op) {
+      visit(n->left);
+      visit(n->right);
+      n->eval_type = types.num();
+      n->is_assignable = false;
+      for (ASTExpr *operand: {n->left, n->right}) {
+        if (operand->eval_type && operand->eval_type->kind != EvalType::Num) {
+          error(
+            first_token(operand),
+            "operand of `" + std::string(op.sv) + "` is `" +
+            type_name(operand->eval_type) + "`, not an integer"
+          );
+        }
+      }
+    }
+
+    void visit_additive_expr(ASTAdditiveExpr *n) {
+      check_num_operands(n, n->op);
+    }
+
+    void visit_multiplicative_expr(ASTMultiplicativeExpr *n) {
+      check_num_operands(n, n->op);
+    }
+
+    // the other operators have no code generation yet
+    void visit_binary_expr(ASTExpr *n) {
+      visit(n->left);
+      visit(n->right);
+      Token &op = binary_operator(n);
+      error(op, "operator `" + std::string(op.sv) + "` is not supported yet");
+      n->eval_type = nullptr;
+      n->is_assignable = false;
+    }
+
+    void visit_func_call_expr(ASTFuncCallExpr *n) {
+      visit(n->primary);
+      for (ASTExpr *arg: n->args) visit(arg);
+      n->eval_type = nullptr;
+      n->is_assignable = false;
+      if (!n->primary->eval_type) return;
+      if (n->primary->eval_type->kind != EvalType::Func) {
+        error(
+          first_token(n->primary),
+          "calling `" + type_name(n->primary->eval_type) + "`, which is not a function"
+        );
+        return;
+      }
+      TypeFunc *tf = static_cast<TypeFunc *>(n->primary->eval_type);
+      n->eval_type = tf->ret_type;
+      if (n->args.size() != tf->type_args.size()) {
+        error(
+          first_token(n->primary),
+          "the function takes " + std::to_string(tf->type_args.size()) +
+          " arguments, found " + std::to_string(n->args.size())
+        );
+        return;
+      }
+      for (int i = 0; i < (int)n->args.size(); i++) {
+        EvalType *arg_type = n->args[i]->eval_type;
+        if (arg_type && tf->type_args[i] && !is_convertible(tf->type_args[i], arg_type)) {
+          error(
+            first_token(n->args[i]),
+            "passing `" + type_name(arg_type) + "` as an argument of type `" +
+            type_name(tf->type_args[i]) + "`"
+          );
+        }
+      }
+    }
+
+    void visit_primary_expr(ASTPrimaryExpr *n) {
+      visit(n->expr);
+      n->eval_type = n->expr->eval_type;
+      n->is_assignable = n->expr->is_assignable;
+    }
+
+    void visit_simple_expr(ASTSimpleExpr *n) {
+      n->is_assignable = false;
+      if (n->op.type == NumberConstant) {
+        n->eval_type = types.num();
+        // number_value relies on this, 2^63 and above wrap around
+        uint64_t value;
+        const char *p = n->op.sv.data(), *end = p + n->op.sv.size();
+        if (std::from_chars(p, end, value).ec == std::errc::result_out_of_range) {
+          error(n->op, "`" + std::string(n->op.sv) + "` does not fit in 64 bits");
+        }
+        return;
+      }
+      Var *v = symbols.get_var(n->op);
+      if (!v) {
+        error(n->op, "`" + std::string(n->op.sv) + "` is not declared");
+        return;
+      }
+      EvalType *type = v->decl->type;
+      n->eval_type = type;
+      n->is_global = v->depth == 0;
+      if (!n->is_global) local_refs.push_back({n, v->decl});
+      // functions are not variables
+      n->is_assignable = !n->is_global || !type || type->kind != EvalType::Func;
+    }
+  };
+
+  bool check(AST *ast, NameTable &names, TypeContext &types, std::vector<Diagnostic> &diags) {
+    size_t n = diags.size();
+    Checker(names, types, diags).visit(ast);
+    // in the order of the source
+    std::stable_sort(diags.begin() + n, diags.end(), [](const Diagnostic &a, const Diagnostic &b) {
+      return a.token.sv.data() < b.token.sv.data();
+    });
+    return diags.size() == n;
+  }
+}
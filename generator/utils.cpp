@@ -0,0 +1,7 @@
+#include "./generator.hpp"
+
+namespace generator {
+  std::string Diagnostic::get_error_string(LineTable &lines) {
+    return get_located_string(lines, token, "error: " + message);
+  }
+}
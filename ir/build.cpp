@@ -0,0 +1,259 @@
+#include "./ir.hpp"
+
+namespace ir {
+  void Func::link_blocks() {
+    for (Block &b: blocks) {
+      b.preds.clear();
+      b.succs.clear();
+      b.pred_index.clear();
+    }
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+      uint32_t t = blocks[i].terminator();
+      if (t == none) continue;
+      for (uint32_t target: insts[t].targets) {
+        if (target == none) continue;
+        blocks[i].succs.push_back(target);
+        blocks[i].pred_index.push_back(blocks[target].preds.size());
+        blocks[target].preds.push_back(i);
+      }
+    }
+  }
+
+  // lowers a checked function
+  // expressions return the value holding their result
+  class Builder : public Visitor<Builder, uint32_t> {
+    public:
+    TypeContext &types;
+    Func *f;
+    uint32_t cur; // the block being filled, none after a terminator
+    // slot of each local by its offset from rbp, which check made unique
+    std::vector<uint32_t> slot_of_offset;
+    Builder(TypeContext &t, Func *fn) : types(t), f(fn), cur(none) {}
+
+    uint32_t add(Inst inst) {
+      if (cur == none) cur = f->add_block(); // unreachable code
+      f->insts.push_back(std::move(inst));
+      uint32_t v = f->insts.size() - 1;
+      f->blocks[cur].insts.push_back(v);
+      if (f->insts[v].is_terminator()) cur = none;
+      return v;
+    }
+
+    uint32_t add(Inst::Op op, EvalType *type, std::vector<uint32_t> ops) {
+      Inst inst(op, type);
+      inst.ops = std::move(ops);
+      return add(std::move(inst));
+    }
+
+    void jump(uint32_t target) {
+      Inst inst(Inst::Jmp, nullptr);
+      inst.targets[0] = target;
+      add(std::move(inst));
+    }
+
+    // the value converted to type, as a store to a variable of type would
+    uint32_t convert(uint32_t v, EvalType *type) {
+      if (f->insts[v].type == type || type_size(type) == 8) return v;
+      return add(Inst::Ext, type, {v});
+    }
+
+    uint32_t add_slot(ASTDeclarator *d) {
+      f->slots.emplace_back(d->type, d->op);
+      slot_of_offset[d->offset] = f->slots.size() - 1;
+      return f->slots.size() - 1;
+    }
+
+    void store_slot(uint32_t slot, uint32_t v) {
+      Inst inst(Inst::Store, f->slots[slot].type);
+      inst.slot = slot;
+      inst.ops = {v};
+      add(std::move(inst));
+    }
+
+    uint32_t visit_func_def(ASTFuncDef *n) {
+      ASTFuncDeclarator *fd = n->declaration->declarator;
+      slot_of_offset.assign(n->frame_size + 1, none);
+      cur = f->add_block();
+      // all args come first, so they are taken from their registers at once
+      std::vector<uint32_t> args;
+      for (int i = 0; i < (int)fd->args.size(); i++) {
+        Inst arg(Inst::Arg, types.num());
+        arg.imm = i;
+        args.push_back(add(std::move(arg)));
+      }
+      for (int i = 0; i < (int)fd->args.size(); i++) {
+        ASTDeclarator *d = fd->args[i]->declarator;
+        // the caller may leave garbage above the width of the argument
+        store_slot(add_slot(d), convert(args[i], d->type));
+      }
+      visit(n->body);
+      if (cur != none) add(Inst::Ret, nullptr, {}); // no value, as the tree generator
+      f->link_blocks();
+      return none;
+    }
+
+    uint32_t visit_declaration(ASTDeclaration *n) {
+      for (ASTDeclarator *d: n->declarators) add_slot(d);
+      return none;
+    }
+
+    // declarations of a block are in scope in all of its statements
+    uint32_t visit_comp_stmt(ASTCompoundStmt *n) {
+      for (AST *item: n->items) {
+        if (item->kind == AST::Declaration) visit(item);
+      }
+      for (AST *item: n->items) {
+        if (item->kind != AST::Declaration) visit(item);
+      }
+      return none;
+    }
+
+    uint32_t visit_if_stmt(ASTIfStmt *n) {
+      uint32_t end = f->add_block();
+      lower_branch(n->cond, n->true_stmt, end);
+      for (ASTElseStmt *e = n->false_stmt; e; e = e->false_stmt) {
+        lower_branch(e->cond, e->true_stmt, end);
+      }
+      if (cur != none) jump(end);
+      cur = end;
+      return none;
+    }
+
+    // cond is null for else
+    // leaves cur at the block taken when cond is 0
+    void lower_branch(ASTExpr *cond, ASTCompoundStmt *true_stmt, uint32_t end) {
+      if (!cond) {
+        visit(true_stmt);
+        return;
+      }
+      uint32_t c = visit(cond);
+      if (f->insts[c].op == Inst::Const) {
+        // the branch not taken is left unreachable for build_ssa
+        if (!f->insts[c].imm) return;
+        visit(true_stmt);
+        if (cur != none) jump(end);
+        cur = none;
+        return;
+      }
+      Inst br(Inst::Br, nullptr);
+      br.ops = {c};
+      uint32_t true_block = br.targets[0] = f->add_block();
+      uint32_t false_block = br.targets[1] = f->add_block();
+      add(std::move(br));
+      cur = true_block;
+      visit(true_stmt);
+      if (cur != none) jump(end);
+      cur = false_block;
+    }
+
+    uint32_t visit_expr_stmt(ASTExprStmt *n) {
+      visit(n->expr);
+      return none;
+    }
+
+    uint32_t visit_return_stmt(ASTReturnStmt *n) {
+      uint32_t v = visit(n->expr);
+      add(Inst::Ret, nullptr, {convert(v, f->type->ret_type)});
+      return none;
+    }
+
+    // where an assignable expr lives, a slot or an address
+    std::pair<uint32_t, uint32_t> lower_place(ASTExpr *n) {
+      while (n->kind == AST::PrimaryExpr) n = static_cast<ASTPrimaryExpr *>(n)->expr;
+      assert(n->kind == AST::SimpleExpr);
+      ASTSimpleExpr *s = static_cast<ASTSimpleExpr *>(n);
+      if (!s->is_global) return {slot_of_offset[s->offset], none};
+      Inst g(Inst::Global, types.pointer(s->eval_type));
+      g.sym = s->op.sv;
+      return {none, add(std::move(g))};
+    }
+
+    // a variable used as an operand is read only after all operands
+    // of its operator are evaluated, as the tree generator does,
+    // so `x + (x: 1)` is 2
+    class Operand {
+      public:
+      uint32_t value, slot, addr;
+      EvalType *type;
+    };
+
+    Operand lower_operand(ASTExpr *n) {
+      if (!n->is_assignable) return {visit(n), none, none, n->eval_type};
+      auto [slot, addr] = lower_place(n);
+      return {none, slot, addr, n->eval_type};
+    }
+
+    uint32_t read(Operand &o) {
+      if (o.value != none) return o.value;
+      Inst load(Inst::Load, o.type);
+      load.slot = o.slot;
+      if (o.addr != none) load.ops = {o.addr};
+      return add(std::move(load));
+    }
+
+    uint32_t visit_assign_expr(ASTAssignExpr *n) {
+      auto [slot, addr] = lower_place(n->left);
+      uint32_t v = convert(visit(n->right), n->left->eval_type);
+      Inst store(Inst::Store, n->left->eval_type);
+      store.slot = slot;
+      store.ops = {v};
+      if (addr != none) store.ops.push_back(addr);
+      add(std::move(store));
+      return v;
+    }
+
+    uint32_t visit_additive_expr(ASTAdditiveExpr *n) {
+      Inst::Op op = n->op.type == PlusTok ? Inst::Add : Inst::Sub;
+      Operand l = lower_operand(n->left), r = lower_operand(n->right);
+      uint32_t lv = read(l);
+      return add(op, types.num(), {lv, read(r)});
+    }
+
+    uint32_t visit_multiplicative_expr(ASTMultiplicativeExpr *n) {
+      Inst::Op op = n->op.type == StarTok ? Inst::Mul : n->op.type == SlashTok ? Inst::Div : Inst::Mod;
+      Operand l = lower_operand(n->left), r = lower_operand(n->right);
+      uint32_t lv = read(l);
+      return add(op, types.num(), {lv, read(r)});
+    }
+
+    uint32_t visit_func_call_expr(ASTFuncCallExpr *n) {
+      TypeFunc *tf = static_cast<TypeFunc *>(n->primary->eval_type);
+      std::vector<uint32_t> ops = {visit(n->primary)};
+      std::vector<Operand> args;
+      for (ASTExpr *arg: n->args) args.push_back(lower_operand(arg));
+      // extended by both the caller, as the C ABI wants,
+      // and the callee, which may be called from C
+      for (int i = 0; i < (int)args.size(); i++) {
+        ops.push_back(convert(read(args[i]), tf->type_args[i]));
+      }
+      return add(Inst::Call, tf->ret_type, std::move(ops));
+    }
+
+    uint32_t visit_primary_expr(ASTPrimaryExpr *n) {
+      return visit(n->expr);
+    }
+
+    uint32_t visit_simple_expr(ASTSimpleExpr *n) {
+      if (n->op.type == NumberConstant) {
+        Inst c(Inst::Const, n->eval_type);
+        c.imm = number_value(n->op);
+        return add(std::move(c));
+      }
+      if (!n->is_assignable) {
+        // a function, its address is the value
+        Inst g(Inst::Global, n->eval_type);
+        g.sym = n->op.sv;
+        return add(std::move(g));
+      }
+      Operand o = lower_operand(n);
+      return read(o);
+    }
+  };
+
+  Func build(ASTFuncDef *n, TypeContext &types) {
+    ASTDeclarator *d = n->declaration->declarator->declarator;
+    Func ret(d->op, static_cast<TypeFunc *>(d->type));
+    Builder(types, &ret).visit(n);
+    return ret;
+  }
+}
@@ -0,0 +1,39 @@
+#include "./ir.hpp"
+
+namespace ir {
+  // kept whether their results are used or not; a division may trap
+  static bool has_effects(Inst &inst) {
+    switch (inst.op) {
+    case Inst::Store: case Inst::Call: case Inst::Div: case Inst::Mod:
+      return true;
+    default:
+      return inst.is_terminator();
+    }
+  }
+
+  // marks what the instructions with effects use, transitively, so
+  // phis that only feed each other are removed too
+  void remove_dead_code(Func &f) {
+    std::vector<bool> live(f.insts.size());
+    std::vector<uint32_t> work;
+    for (Block &b: f.blocks) {
+      for (uint32_t v: b.insts) {
+        if (!has_effects(f.insts[v])) continue;
+        live[v] = true;
+        work.push_back(v);
+      }
+    }
+    while (!work.empty()) {
+      uint32_t v = work.back();
+      work.pop_back();
+      for (uint32_t op: f.insts[v].ops) {
+        if (live[op]) continue;
+        live[op] = true;
+        work.push_back(op);
+      }
+    }
+    for (Block &b: f.blocks) {
+      b.insts.erase(std::remove_if(b.insts.begin(), b.insts.end(), [&](uint32_t v) { return !live[v]; }), b.insts.end());
+    }
+  }
+}
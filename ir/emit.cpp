@@ -0,0 +1,293 @@
+#include "./ir.hpp"
+
+namespace ir {
+  static int label_number = 0;
+
+  // values are where allocate_registers put them; r10 and r11 are
+  // scratch for values on the stack, r11 also breaks cycles of moves
+  class Emitter {
+    public:
+    Func &f;
+    std::string &code;
+    Allocation a;
+    int label_base;
+    size_t next_move = 0;
+    int frame_size = 0; // below the saved registers
+    Emitter(Func &fn, std::string &c)
+    : f(fn), code(c), a(allocate_registers(fn)), label_base(label_number) {
+      label_number += f.blocks.size();
+    }
+
+    std::string label(uint32_t b) {
+      return "L" + std::to_string(label_base + b);
+    }
+
+    // spill slots are below the saved registers
+    std::string mem(Loc l) {
+      return "[rbp - " + std::to_string(8 * (a.saved.size() + l.n + 1)) + "]";
+    }
+
+    std::string name(Loc l) {
+      return l.kind == Loc::Reg ? reg_names[l.n] : mem(l);
+    }
+
+    static bool fits_imm32(int64_t imm) {
+      return imm >= INT32_MIN && imm <= INT32_MAX;
+    }
+
+    // the value v, which is at l, into reg
+    void get(int reg, uint32_t v, Loc l) {
+      Inst &inst = f.insts[v];
+      const std::string &r = reg_names[reg];
+      if (l.kind == Loc::Reg) {
+        if (l.n != reg) code += "mov " + r + ", " + reg_names[l.n] + "\n";
+      } else if (l.kind == Loc::Stack) {
+        code += "mov " + r + ", " + mem(l) + "\n";
+      } else if (inst.op == Inst::Const) {
+        code += "mov " + r + ", " + std::to_string(inst.imm) + "\n";
+      } else if (inst.op == Inst::Global) {
+        code += "mov " + r + ", [rip + " + std::string(inst.sym) + "@GOTPCREL]\n";
+      }
+    }
+
+    // reg into l, which is where the result of an instruction goes
+    void put(Loc l, int reg) {
+      if (l.kind == Loc::Stack) code += "mov " + mem(l) + ", " + reg_names[reg] + "\n";
+      else if (l.kind == Loc::Reg && l.n != reg) code += "mov " + reg_names[l.n] + ", " + reg_names[reg] + "\n";
+    }
+
+    // the value v, which is at l, as the second operand of add, sub or imul
+    std::string source(uint32_t v, Loc l) {
+      Inst &inst = f.insts[v];
+      if (l.kind != Loc::None) return name(l);
+      if (inst.op == Inst::Const && fits_imm32(inst.imm)) return std::to_string(inst.imm);
+      get(R11, v, l);
+      return "r11";
+    }
+
+    void move(Move &m) {
+      if (m.dst.kind == Loc::Reg) {
+        get(m.dst.n, m.value, m.src);
+      } else if (m.src.kind == Loc::Reg) {
+        put(m.dst, m.src.n);
+      } else if (m.src.kind == Loc::None && f.insts[m.value].op == Inst::Const && fits_imm32(f.insts[m.value].imm)) {
+        code += "mov qword ptr " + mem(m.dst) + ", " + std::to_string(f.insts[m.value].imm) + "\n";
+      } else {
+        get(R10, m.value, m.src);
+        put(m.dst, R10);
+      }
+    }
+
+    // all of moves at once: a destination is written after it is read
+    void parallel_move(std::vector<Move> moves) {
+      moves.erase(std::remove_if(moves.begin(), moves.end(), [](Move &m) { return m.src == m.dst; }), moves.end());
+      while (!moves.empty()) {
+        bool progress = false;
+        for (size_t i = 0; i < moves.size();) {
+          bool read = false;
+          for (Move &m: moves) read |= m.src == moves[i].dst;
+          if (read) {
+            i++;
+            continue;
+          }
+          move(moves[i]);
+          moves.erase(moves.begin() + i);
+          progress = true;
+        }
+        if (progress) continue;
+        // the rest are cycles, one destination is read from r11 instead
+        Loc d = moves[0].dst;
+        get(R11, moves[0].value, d);
+        for (Move &m: moves) {
+          if (m.src == d) m.src = Loc(Loc::Reg, R11);
+        }
+      }
+    }
+
+    // the moves between pieces of values at p
+    void split_moves(uint32_t p) {
+      std::vector<Move> moves;
+      for (; next_move < a.moves.size() && a.moves[next_move].first <= p; next_move++) {
+        moves.push_back(a.moves[next_move].second);
+      }
+      parallel_move(moves);
+    }
+
+    void epilogue() {
+      if (a.saved.empty()) {
+        if (frame_size) code += "mov rsp, rbp\n";
+      } else {
+        if (frame_size) code += "lea rsp, [rbp - " + std::to_string(8 * a.saved.size()) + "]\n";
+        for (auto r = a.saved.rbegin(); r != a.saved.rend(); ++r) code += "pop " + reg_names[*r] + "\n";
+      }
+      code += "pop rbp\n";
+      code += "ret\n";
+    }
+
+    void emit_inst(uint32_t b, uint32_t v) {
+      Inst &inst = f.insts[v];
+      uint32_t p = a.pos[v];
+      Loc dst = a.at(v, p + 3);
+      auto at = [&](uint32_t i) { return a.at(inst.ops[i], p); };
+      // where the result is computed
+      int w = dst.kind == Loc::Reg ? dst.n : R10;
+      switch (inst.op) {
+      case Inst::Const: case Inst::Undef: case Inst::Phi: case Inst::Arg:
+        break;
+      case Inst::Global:
+        code += ".global " + std::string(inst.sym) + "\n";
+        break;
+      case Inst::Load:
+        get(w, inst.ops[0], at(0));
+        load(code, reg_names[w], inst.type);
+        put(dst, w);
+        break;
+      case Inst::Store: {
+        Loc addr = at(1), value = at(0);
+        int ar = addr.kind == Loc::Reg ? addr.n : R10, vr = value.kind == Loc::Reg ? value.n : R11;
+        get(ar, inst.ops[1], addr);
+        get(vr, inst.ops[0], value);
+        code += "mov [" + reg_names[ar] + "], " + sized_reg(reg_names[vr], type_size(inst.type)) + "\n";
+        break;
+      }
+      case Inst::Add: case Inst::Sub: case Inst::Mul: {
+        static const char *names[] = {"add", "sub", "imul"};
+        uint32_t x = inst.ops[0], y = inst.ops[1];
+        Loc lx = at(0), ly = at(1);
+        // w is written before y is read
+        if (ly == Loc(Loc::Reg, w) && lx != ly) {
+          if (inst.op != Inst::Sub) {
+            std::swap(x, y);
+            std::swap(lx, ly);
+          } else {
+            code += "mov r11, " + reg_names[w] + "\n";
+            ly = Loc(Loc::Reg, R11);
+          }
+        }
+        get(w, x, lx);
+        std::string src = source(y, ly);
+        if (inst.op == Inst::Mul && ly.kind == Loc::None && src != "r11") {
+          code += "imul " + reg_names[w] + ", " + reg_names[w] + ", " + src + "\n";
+        } else {
+          code += std::string(names[inst.op - Inst::Add]) + " " + reg_names[w] + ", " + src + "\n";
+        }
+        put(dst, w);
+        break;
+      }
+      case Inst::Div: case Inst::Mod:
+        get(R11, inst.ops[1], at(1));
+        get(RAX, inst.ops[0], at(0));
+        code += "cqo\n";
+        code += "idiv r11\n";
+        put(dst, inst.op == Inst::Div ? RAX : RDX);
+        break;
+      case Inst::Ext:
+        get(w, inst.ops[0], at(0));
+        extend(code, reg_names[w], inst.type);
+        put(dst, w);
+        break;
+      case Inst::Call: {
+        static const int param_regs[] = {RDI, RSI, RDX, RCX, R8, R9};
+        std::vector<Move> moves;
+        for (uint32_t i = 1; i < inst.ops.size(); i++) moves.emplace_back(Loc(Loc::Reg, param_regs[i - 1]), at(i), inst.ops[i]);
+        Inst &callee = f.insts[inst.ops[0]];
+        if (callee.op != Inst::Global) moves.emplace_back(Loc(Loc::Reg, RAX), at(0), inst.ops[0]);
+        parallel_move(moves);
+        // rsp is aligned, the frame is a multiple of 16
+        if (callee.op == Inst::Global) code += "call [rip + " + std::string(callee.sym) + "@GOTPCREL]\n";
+        else code += "call rax\n";
+        put(dst, RAX);
+        break;
+      }
+      case Inst::Jmp:
+        parallel_move(a.exit_moves[b]);
+        if (inst.targets[0] != b + 1) code += "jmp " + label(inst.targets[0]) + "\n";
+        break;
+      case Inst::Br: {
+        Loc l = at(0);
+        if (l.kind == Loc::Reg) {
+          code += "test " + reg_names[l.n] + ", " + reg_names[l.n] + "\n";
+        } else if (l.kind == Loc::Stack) {
+          code += "cmp qword ptr " + mem(l) + ", 0\n";
+        } else {
+          get(R10, inst.ops[0], l);
+          code += "test r10, r10\n";
+        }
+        if (inst.targets[0] == b + 1) {
+          code += "jz " + label(inst.targets[1]) + "\n";
+        } else {
+          code += "jnz " + label(inst.targets[0]) + "\n";
+          if (inst.targets[1] != b + 1) code += "jmp " + label(inst.targets[1]) + "\n";
+        }
+        break;
+      }
+      case Inst::Ret:
+        if (!inst.ops.empty()) get(RAX, inst.ops[0], at(0));
+        epilogue();
+        break;
+      }
+    }
+
+    void emit() {
+      std::string name(f.name.sv);
+      code += ".global " + name + "\n";
+      code += name + ":\n";
+      code += "push rbp\n";
+      code += "mov rbp, rsp\n";
+      for (int r: a.saved) code += "push " + reg_names[r] + "\n";
+      // rsp stays a multiple of 16 below the saved registers and slots
+      frame_size = (8 * (a.saved.size() + a.num_spill_slots) + 15) & ~15;
+      frame_size -= 8 * a.saved.size();
+      if (frame_size) code += "sub rsp, " + std::to_string(frame_size) + "\n";
+
+      // the args are taken from their registers at once
+      static const int param_regs[] = {RDI, RSI, RDX, RCX, R8, R9};
+      std::vector<Move> args;
+      for (uint32_t v: f.blocks[0].insts) {
+        Inst &inst = f.insts[v];
+        if (inst.op == Inst::Arg) args.emplace_back(a.at(v, a.pos[v] + 3), Loc(Loc::Reg, param_regs[inst.imm]), v);
+      }
+      args.erase(std::remove_if(args.begin(), args.end(), [](Move &m) { return m.dst.kind == Loc::None; }), args.end());
+      parallel_move(args);
+
+      for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        if (b) code += label(b) + ":\n";
+        parallel_move(a.entry_moves[b]);
+        for (uint32_t v: f.blocks[b].insts) {
+          if (f.insts[v].op == Inst::Phi) continue;
+          split_moves(a.pos[v]);
+          emit_inst(b, v);
+        }
+      }
+    }
+  };
+
+  void emit(Func &f, std::string &out) {
+    Emitter(f, out).emit();
+  }
+
+  bool generate(AST *ast, TypeContext &types, bool emit_ir, std::string &out, std::vector<std::string> &errors) {
+    if (!emit_ir) {
+      out += ".intel_syntax noprefix\n";
+      out += ".text\n";
+    }
+    // globals without an initializer are defined elsewhere
+    for (AST *d: static_cast<ASTTranslationUnit *>(ast)->external_declarations) {
+      if (d->kind != AST::FuncDef) {
+        for (ASTDeclarator *g: static_cast<ASTExternalDeclaration *>(d)->declarators) {
+          if (!g->init) continue;
+          if (emit_ir) out += (out.empty() ? "" : "\n") + to_string(g);
+          else define_global(out, g);
+        }
+        continue;
+      }
+      Func f = build(static_cast<ASTFuncDef *>(d), types);
+      build_ssa(f);
+      remove_dead_code(f);
+      if (!verify(f, true, errors)) return false;
+      if (emit_ir) out += (out.empty() ? "" : "\n") + to_string(f);
+      else emit(f, out);
+    }
+    return true;
+  }
+}
@@ -0,0 +1,199 @@
+#ifndef IR_HPP
+#define IR_HPP
+#include "bits/stdc++.h"
+#include "../tokenizer/tokenizer.hpp"
+#include "../parser/parser.hpp"
+#include "../generator/generator.hpp"
+
+// a typed three-address code between the checked tree and x86
+// a function is a list of basic blocks, each a list of instructions
+// ended by one terminator; values are the results of instructions
+// and are named by the index of the instruction in Func::insts
+namespace ir {
+  using namespace tokenizer;
+  using namespace parser;
+  using namespace generator;
+
+  static const uint32_t none = UINT32_MAX;
+
+  class Inst {
+    public:
+    enum Op {
+      Const,  // imm
+      Undef,  // a local read before it is written
+      Arg,    // imm-th argument
+      Global, // address of the global named sym
+      Load,   // from slot, or from the address ops[0] if slot is none
+      Store,  // ops[0] to slot, or to the address ops[1] if slot is none
+      Add,
+      Sub,
+      Mul,
+      Div,
+      Mod,
+      Ext,    // truncate ops[0] to type and extend it back to 64 bits
+      Call,   // ops[0](ops[1], ...)
+      Phi,    // ops[i] comes from the i-th predecessor
+      Jmp,    // to targets[0]
+      Br,     // to targets[0] if ops[0] is not 0, else to targets[1]
+      Ret,    // ops[0] if any
+    };
+    Op op;
+    // of the result; integers are kept in 64 bits and extended
+    // from this type; the type stored or loaded for Store and Load
+    EvalType *type;
+    std::vector<uint32_t> ops;
+    int64_t imm;
+    uint32_t slot;
+    uint32_t targets[2];
+    std::string_view sym;
+    Inst(Op o, EvalType *t)
+    : op(o), type(t), imm(0), slot(none), targets{none, none} {}
+
+    bool is_terminator() const { return op >= Jmp; }
+    bool has_result() const { return op != Store && !is_terminator(); }
+  };
+
+  class Block {
+    public:
+    std::vector<uint32_t> insts;
+    std::vector<uint32_t> preds;
+    std::vector<uint32_t> succs;
+    // where this block is in the preds of each of succs,
+    // which is the operand of the phis there that comes from it
+    std::vector<uint32_t> pred_index;
+
+    uint32_t terminator() const { return insts.empty() ? none : insts.back(); }
+  };
+
+  // a local variable or argument, promoted to values by build_ssa
+  class Slot {
+    public:
+    EvalType *type;
+    Token name;
+    Slot(EvalType *t, Token &n) : type(t), name(n) {}
+  };
+
+  class Func {
+    public:
+    Token name;
+    TypeFunc *type;
+    std::vector<Inst> insts;
+    std::vector<Block> blocks; // blocks[0] is the entry
+    std::vector<Slot> slots;
+    Func(Token &n, TypeFunc *t) : name(n), type(t) {}
+
+    uint32_t add_block() {
+      blocks.emplace_back();
+      return blocks.size() - 1;
+    }
+
+    // preds, succs and pred_index from the terminators
+    void link_blocks();
+  };
+
+  // build.cpp
+  // n must have passed check; slots are loaded and stored explicitly
+  Func build(ASTFuncDef *n, TypeContext &types);
+
+  // ssa.cpp
+  // removes unreachable blocks and splits critical edges,
+  // then promotes every slot to SSA values joined by phis
+  void build_ssa(Func &f);
+
+  // dce.cpp
+  // removes the values of f that are not used and whose instructions
+  // have no effects, f must be in SSA form
+  void remove_dead_code(Func &f);
+
+  // verify.cpp
+  // appends a message for every broken invariant of f
+  // ssa: also checks that each use is dominated by its definition
+  // and that no slots are left
+  bool verify(Func &f, bool ssa, std::vector<std::string> &errors);
+
+  // print.cpp
+  std::string to_string(Func &f);
+  // a global with an initializer
+  std::string to_string(ASTDeclarator *global);
+
+  // x86 registers by their number in instruction encodings
+  enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+  extern const std::string reg_names[16];
+
+  // where a value is: a register, a spill slot below the frame, or
+  // nowhere for constants, undefs and addresses of globals, which are
+  // rematerialized where they are used
+  class Loc {
+    public:
+    enum Kind { None, Reg, Stack };
+    Kind kind;
+    int n; // the register or the spill slot
+    Loc(Kind k = None, int i = 0) : kind(k), n(i) {}
+    bool operator==(const Loc &o) const { return kind == o.kind && n == o.n; }
+    bool operator!=(const Loc &o) const { return !(*this == o); }
+  };
+
+  // dst takes the value from src, or rematerializes value if src is None
+  class Move {
+    public:
+    Loc dst, src;
+    uint32_t value;
+    Move(Loc d, Loc s, uint32_t v) : dst(d), src(s), value(v) {}
+  };
+
+  // each instruction has 4 positions from pos: moves between pieces are
+  // at pos, operands are read before pos + 2, calls and idiv clobber
+  // registers at pos + 2 and the result is written at pos + 3
+  // phis are at the start of their block, which has no instruction
+  class Allocation {
+    public:
+    class Piece {
+      public:
+      uint32_t start, end;
+      Loc loc;
+    };
+    std::vector<uint32_t> pos;
+    std::vector<uint32_t> block_begin; // and the end of the last block
+    // of the live range of each value, by start; empty for values
+    // that are rematerialized
+    std::vector<std::vector<Piece>> pieces;
+    // between pieces of a value that is live across the start of the
+    // next one, by position, and on the edges between blocks: at the
+    // end of the block if it has one successor, else at the start of
+    // the successor, which has one predecessor as critical edges are split
+    std::vector<std::pair<uint32_t, Move>> moves;
+    std::vector<std::vector<Move>> entry_moves, exit_moves;
+    int num_spill_slots = 0;
+    std::vector<int> saved; // callee-saved registers that are used
+
+    Loc at(uint32_t v, uint32_t p) const;
+  };
+
+  // regalloc.cpp
+  // linear scan over the blocks of f in order, which must be in SSA form
+  // r10 and r11 are left free for the emitter, and no value is in a
+  // caller-saved register across a call
+  Allocation allocate_registers(Func &f);
+
+  // emit.cpp
+  // x86-64 in intel syntax, f must be in SSA form
+  void emit(Func &f, std::string &out);
+  // lowers the functions of ast one at a time, so the IR of only one
+  // is alive, and appends their assembly to out, or their IR if emit_ir
+  // false if the IR is broken, which is a bug of l4tc
+  bool generate(AST *ast, TypeContext &types, bool emit_ir, std::string &out, std::vector<std::string> &errors);
+
+  // dominators of the reachable blocks of f, blocks[0] is the root
+  // idom[b] is none for the entry and for unreachable blocks
+  class DomTree {
+    public:
+    std::vector<uint32_t> rpo; // reachable blocks in reverse post-order
+    std::vector<uint32_t> rpo_index; // none if unreachable
+    std::vector<uint32_t> idom;
+    std::vector<std::vector<uint32_t>> children;
+    std::vector<uint32_t> pre, post; // numbers of a walk of the tree
+    DomTree(Func &f);
+    bool dominates(uint32_t a, uint32_t b);
+  };
+}
+#endif
@@ -0,0 +1,143 @@
+#include "./ir.hpp"
+
+namespace ir {
+  // values are named by their index, as the verifier names them
+  //   func fib(i32) -> i32
+  //   b0:
+  //     %0 = arg num 0
+  //     %1 = ext i32 %0
+  //     br %1, b1, b2
+  //   b1: ; preds b0
+  //     ...
+  //   b3: ; preds b1, b2
+  //     %9 = phi i32 [b1 %4], [b2 %7]
+  //     ret %9
+  class Printer {
+    public:
+    Func &f;
+    std::string &out;
+    Printer(Func &fn, std::string &o) : f(fn), out(o) {}
+
+    void value(uint32_t v) {
+      out += v == none ? "%?" : "%" + std::to_string(v);
+    }
+
+    void block(uint32_t b) {
+      out += "b" + std::to_string(b);
+    }
+
+    void slot(uint32_t s) {
+      out += "$" + std::string(f.slots[s].name.sv) + "." + std::to_string(s);
+    }
+
+    void address(uint32_t v) {
+      out += "[";
+      value(v);
+      out += "]";
+    }
+
+    void inst(Inst &inst, uint32_t b) {
+      static const char *names[] = {
+        "const", "undef", "arg", "global", "load", "store", "add", "sub", "mul",
+        "div", "mod", "ext", "call", "phi", "jmp", "br", "ret",
+      };
+      out += "  ";
+      if (inst.has_result()) {
+        value(&inst - f.insts.data());
+        out += " = ";
+      }
+      out += names[inst.op];
+      if (inst.type) out += " " + type_name(inst.type);
+      switch (inst.op) {
+      case Inst::Const: case Inst::Arg:
+        out += " " + std::to_string(inst.imm);
+        break;
+      case Inst::Global:
+        out += " @" + std::string(inst.sym);
+        break;
+      case Inst::Load:
+        out += " ";
+        if (inst.slot != none) slot(inst.slot);
+        else address(inst.ops[0]);
+        break;
+      case Inst::Store:
+        out += " ";
+        if (inst.slot != none) slot(inst.slot);
+        else address(inst.ops[1]);
+        out += ", ";
+        value(inst.ops[0]);
+        break;
+      case Inst::Call:
+        out += " ";
+        value(inst.ops[0]);
+        out += "(";
+        for (uint32_t i = 1; i < inst.ops.size(); i++) {
+          if (i > 1) out += ", ";
+          value(inst.ops[i]);
+        }
+        out += ")";
+        break;
+      case Inst::Phi:
+        for (uint32_t i = 0; i < inst.ops.size(); i++) {
+          out += i ? ", [" : " [";
+          block(f.blocks[b].preds[i]);
+          out += " ";
+          value(inst.ops[i]);
+          out += "]";
+        }
+        break;
+      case Inst::Jmp:
+        out += " ";
+        block(inst.targets[0]);
+        break;
+      case Inst::Br:
+        out += " ";
+        value(inst.ops[0]);
+        out += ", ";
+        block(inst.targets[0]);
+        out += ", ";
+        block(inst.targets[1]);
+        break;
+      default:
+        for (uint32_t i = 0; i < inst.ops.size(); i++) {
+          out += i ? ", " : " ";
+          value(inst.ops[i]);
+        }
+        break;
+      }
+      out += "\n";
+    }
+
+    void print() {
+      // the type without "funcp "
+      out += "func " + std::string(f.name.sv) + type_name(f.type).substr(6) + "\n";
+      for (uint32_t s = 0; s < f.slots.size(); s++) {
+        out += "  ";
+        slot(s);
+        out += ": " + type_name(f.slots[s].type) + "\n";
+      }
+      for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        block(b);
+        out += ":";
+        for (uint32_t i = 0; i < f.blocks[b].preds.size(); i++) {
+          out += i ? ", " : " ; preds ";
+          block(f.blocks[b].preds[i]);
+        }
+        out += "\n";
+        for (uint32_t v: f.blocks[b].insts) inst(f.insts[v], b);
+      }
+    }
+  };
+
+  //   data i32 @g 200
+  std::string to_string(ASTDeclarator *global) {
+    return "data " + type_name(global->type) + " @" + std::string(global->op.sv) + " " +
+      std::to_string(init_value(global)) + "\n";
+  }
+
+  std::string to_string(Func &f) {
+    std::string ret;
+    Printer(f, ret).print();
+    return ret;
+  }
+}
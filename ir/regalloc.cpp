@@ -0,0 +1,483 @@
+#include "./ir.hpp"
+
+// linear scan on SSA form, after Wimmer and Franz: live ranges are
+// intervals with holes, which are split where there are not enough
+// registers; the piece that loses its register goes to a spill slot
+// and comes back into one before its next use
+namespace ir {
+  const std::string reg_names[16] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+  };
+
+  // caller-saved first, they cost nothing where no call is around
+  static const int allocatable[] = {RAX, RCX, RDX, RSI, RDI, R8, R9, RBX, R12, R13, R14, R15};
+  static const int caller_saved[] = {RAX, RCX, RDX, RSI, RDI, R8, R9};
+  static const int param_regs[] = {RDI, RSI, RDX, RCX, R8, R9};
+
+  Loc Allocation::at(uint32_t v, uint32_t p) const {
+    const std::vector<Piece> &ps = pieces[v];
+    auto it = std::upper_bound(ps.begin(), ps.end(), p, [](uint32_t p, const Piece &x) { return p < x.start; });
+    return it == ps.begin() ? Loc() : (it - 1)->loc;
+  }
+
+  // the positions where a value, or a piece of it after splitting,
+  // is live, as sorted and disjoint [first, second) ranges
+  class Interval {
+    public:
+    uint32_t value;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    std::vector<uint32_t> uses; // positions where it is read, sorted
+    Loc loc;
+    Interval(uint32_t v) : value(v) {}
+
+    uint32_t start() const { return ranges.front().first; }
+    uint32_t end() const { return ranges.back().second; }
+
+    // the first range that ends after p
+    size_t find(uint32_t p) const {
+      return std::upper_bound(ranges.begin(), ranges.end(), p, [](uint32_t p, const std::pair<uint32_t, uint32_t> &r) {
+        return p < r.second;
+      }) - ranges.begin();
+    }
+
+    bool covers(uint32_t p) const {
+      size_t i = find(p);
+      return i < ranges.size() && ranges[i].first <= p;
+    }
+
+    // the first position from p on that both cover
+    uint32_t intersection(const Interval &o, uint32_t p) const {
+      size_t i = find(p), j = o.find(p);
+      while (i < ranges.size() && j < o.ranges.size()) {
+        uint32_t s = std::max({ranges[i].first, o.ranges[j].first, p});
+        if (s < ranges[i].second && s < o.ranges[j].second) return s;
+        if (ranges[i].second < o.ranges[j].second) i++;
+        else j++;
+      }
+      return none;
+    }
+
+    uint32_t next_use(uint32_t p) const {
+      auto it = std::lower_bound(uses.begin(), uses.end(), p);
+      return it == uses.end() ? none : *it;
+    }
+  };
+
+  class Allocator {
+    public:
+    Func &f;
+    Allocation &a;
+    std::deque<Interval> intervals; // stable under splitting
+    std::vector<uint32_t> interval_of; // the first interval of each value
+    std::vector<int> hint; // a register each value would like, -1 for none
+    std::vector<uint32_t> clobbers[16]; // positions where calls and idiv overwrite a register
+    std::vector<std::vector<uint32_t>> live_in;
+    std::vector<uint32_t> spill_slot;
+    std::priority_queue<std::pair<uint32_t, uint32_t>, std::vector<std::pair<uint32_t, uint32_t>>,
+      std::greater<std::pair<uint32_t, uint32_t>>> unhandled; // by start
+    std::vector<uint32_t> active, inactive; // with a register, covering the position or not
+    bool used[16] = {};
+    Allocator(Func &fn, Allocation &al)
+    : f(fn), a(al), interval_of(fn.insts.size(), none), hint(fn.insts.size(), -1),
+      live_in(fn.blocks.size()), spill_slot(fn.insts.size(), none) {}
+
+    bool is_allocated(uint32_t v) {
+      Inst::Op op = f.insts[v].op;
+      return f.insts[v].has_result() && op != Inst::Const && op != Inst::Global && op != Inst::Undef;
+    }
+
+    // args share one position, they are taken from their registers at once
+    void number() {
+      uint32_t p = 0;
+      a.pos.assign(f.insts.size(), none);
+      for (Block &b: f.blocks) {
+        a.block_begin.push_back(p);
+        p += 4;
+        for (uint32_t v: b.insts) {
+          Inst &inst = f.insts[v];
+          if (inst.op == Inst::Phi) {
+            a.pos[v] = a.block_begin.back();
+          } else if (inst.op == Inst::Arg && inst.imm) {
+            a.pos[v] = p - 4;
+          } else {
+            a.pos[v] = p;
+            p += 4;
+          }
+        }
+      }
+      a.block_begin.push_back(p);
+    }
+
+    // the values live at the end of b, into a successor or to its phis
+    void live_out(uint32_t b, std::vector<uint32_t> &live) {
+      live.clear();
+      Block &block = f.blocks[b];
+      for (uint32_t k = 0; k < block.succs.size(); k++) {
+        uint32_t s = block.succs[k];
+        live.insert(live.end(), live_in[s].begin(), live_in[s].end());
+        for (uint32_t v: f.blocks[s].insts) {
+          if (f.insts[v].op != Inst::Phi) break;
+          uint32_t op = f.insts[v].ops[block.pred_index[k]];
+          if (is_allocated(op)) live.push_back(op);
+        }
+      }
+      std::sort(live.begin(), live.end());
+      live.erase(std::unique(live.begin(), live.end()), live.end());
+    }
+
+    void compute_live_in() {
+      std::vector<uint8_t> in(f.insts.size());
+      std::vector<uint32_t> live, result;
+      // blocks are in reverse post-order, so without loops one pass is enough
+      for (bool changed = true; changed;) {
+        changed = false;
+        for (uint32_t b = f.blocks.size(); b-- > 0;) {
+          live_out(b, live);
+          for (uint32_t v: live) in[v] = 1;
+          std::vector<uint32_t> &insts = f.blocks[b].insts;
+          for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+            in[*it] = 0;
+            if (f.insts[*it].op == Inst::Phi) continue;
+            for (uint32_t op: f.insts[*it].ops) {
+              if (is_allocated(op) && !in[op]) {
+                in[op] = 1;
+                live.push_back(op);
+              }
+            }
+          }
+          result.clear();
+          for (uint32_t v: live) {
+            if (in[v]) result.push_back(v);
+            in[v] = 0;
+          }
+          std::sort(result.begin(), result.end());
+          if (result != live_in[b]) {
+            live_in[b] = result;
+            changed = true;
+          }
+        }
+      }
+    }
+
+    Interval &interval(uint32_t v) {
+      if (interval_of[v] == none) {
+        interval_of[v] = intervals.size();
+        intervals.emplace_back(v);
+      }
+      return intervals[interval_of[v]];
+    }
+
+    // ranges are added from the last position back, so while building
+    // they are kept reversed and ranges.back() is the first
+    void add_range(uint32_t v, uint32_t from, uint32_t to) {
+      std::vector<std::pair<uint32_t, uint32_t>> &r = interval(v).ranges;
+      if (!r.empty() && r.back().first <= to) {
+        r.back().first = std::min(r.back().first, from);
+        r.back().second = std::max(r.back().second, to);
+      } else {
+        r.emplace_back(from, to);
+      }
+    }
+
+    void build_intervals() {
+      std::vector<uint8_t> in(f.insts.size());
+      std::vector<uint32_t> live;
+      for (uint32_t b = f.blocks.size(); b-- > 0;) {
+        Block &block = f.blocks[b];
+        uint32_t begin = a.block_begin[b], end = a.block_begin[b + 1];
+        live_out(b, live);
+        for (uint32_t v: live) {
+          in[v] = 1;
+          add_range(v, begin, end);
+        }
+        for (uint32_t k = 0; k < block.succs.size(); k++) {
+          for (uint32_t v: f.blocks[block.succs[k]].insts) {
+            if (f.insts[v].op != Inst::Phi) break;
+            uint32_t op = f.insts[v].ops[block.pred_index[k]];
+            if (is_allocated(op)) interval(op).uses.push_back(end - 1);
+          }
+        }
+        for (auto it = block.insts.rbegin(); it != block.insts.rend(); ++it) {
+          uint32_t v = *it, p = a.pos[v];
+          Inst &inst = f.insts[v];
+          if (inst.op == Inst::Phi) {
+            if (!in[v]) add_range(v, begin, begin + 1);
+            in[v] = 0;
+            continue;
+          }
+          if (is_allocated(v)) {
+            if (in[v]) interval(v).ranges.back().first = p + 3;
+            else add_range(v, p + 3, p + 4);
+            in[v] = 0;
+          }
+          for (uint32_t op: inst.ops) {
+            if (!is_allocated(op)) continue;
+            add_range(op, begin, p + 2);
+            interval(op).uses.push_back(p);
+            in[op] = 1;
+          }
+          if (inst.op == Inst::Call) {
+            for (int r: caller_saved) clobbers[r].push_back(p + 2);
+          } else if (inst.op == Inst::Div || inst.op == Inst::Mod) {
+            clobbers[RAX].push_back(p + 2);
+            clobbers[RDX].push_back(p + 2);
+          }
+        }
+        for (uint32_t v: live_in[b]) in[v] = 0;
+      }
+      for (Interval &it: intervals) {
+        std::reverse(it.ranges.begin(), it.ranges.end());
+        std::reverse(it.uses.begin(), it.uses.end());
+      }
+      for (std::vector<uint32_t> &c: clobbers) std::reverse(c.begin(), c.end());
+    }
+
+    void set_hints() {
+      for (Block &b: f.blocks) {
+        for (uint32_t v: b.insts) {
+          Inst &inst = f.insts[v];
+          if (inst.op == Inst::Arg && inst.imm < 6) hint[v] = param_regs[inst.imm];
+          else if (inst.op == Inst::Call || inst.op == Inst::Div) hint[v] = RAX;
+          else if (inst.op == Inst::Mod) hint[v] = RDX;
+          else if (inst.op == Inst::Ret && !inst.ops.empty() && hint[inst.ops[0]] < 0) hint[inst.ops[0]] = RAX;
+          if (inst.op == Inst::Call) {
+            for (uint32_t i = 1; i < inst.ops.size() && i <= 6; i++) {
+              if (hint[inst.ops[i]] < 0) hint[inst.ops[i]] = param_regs[i - 1];
+            }
+          }
+        }
+      }
+    }
+
+    // a phi would like the register of a value it joins
+    int hint_of(Interval &it) {
+      Inst &inst = f.insts[it.value];
+      if (hint[it.value] >= 0 || inst.op != Inst::Phi) return hint[it.value];
+      for (uint32_t op: inst.ops) {
+        if (interval_of[op] != none && intervals[interval_of[op]].loc.kind == Loc::Reg) {
+          return intervals[interval_of[op]].loc.n;
+        }
+      }
+      return -1;
+    }
+
+    // the part of interval i from p on becomes a new interval
+    // p must be after its start and before its end
+    uint32_t split(uint32_t i, uint32_t p) {
+      intervals.emplace_back(intervals[i].value);
+      Interval &it = intervals[i], &child = intervals.back();
+      size_t k = it.find(p);
+      child.ranges.assign(it.ranges.begin() + k, it.ranges.end());
+      if (it.ranges[k].first < p) {
+        child.ranges[0].first = p;
+        it.ranges[k].second = p;
+        it.ranges.resize(k + 1);
+      } else {
+        it.ranges.resize(k);
+      }
+      auto u = std::lower_bound(it.uses.begin(), it.uses.end(), p);
+      child.uses.assign(u, it.uses.end());
+      it.uses.erase(u, it.uses.end());
+      return intervals.size() - 1;
+    }
+
+    void assign(Interval &it, int reg) {
+      it.loc = Loc(Loc::Reg, reg);
+      used[reg] = true;
+    }
+
+    void spill(Interval &it) {
+      if (spill_slot[it.value] == none) spill_slot[it.value] = a.num_spill_slots++;
+      it.loc = Loc(Loc::Stack, spill_slot[it.value]);
+    }
+
+    // the first position where a call or idiv overwrites reg while it is live
+    uint32_t clobbered(int reg, Interval &it) {
+      std::vector<uint32_t> &c = clobbers[reg];
+      for (auto p = std::lower_bound(c.begin(), c.end(), it.start()); p != c.end() && *p < it.end(); ++p) {
+        if (it.covers(*p)) return *p;
+      }
+      return none;
+    }
+
+    bool try_allocate_free(uint32_t i) {
+      Interval &cur = intervals[i];
+      uint32_t free_until[16] = {};
+      for (int r: allocatable) free_until[r] = std::min(none, clobbered(r, cur));
+      for (uint32_t x: active) free_until[intervals[x].loc.n] = 0;
+      for (uint32_t x: inactive) {
+        int r = intervals[x].loc.n;
+        free_until[r] = std::min(free_until[r], intervals[x].intersection(cur, cur.start()));
+      }
+      int reg = hint_of(cur);
+      if (reg < 0 || free_until[reg] < cur.end()) {
+        reg = allocatable[0];
+        for (int r: allocatable) {
+          if (free_until[r] > free_until[reg]) reg = r;
+        }
+      }
+      if (free_until[reg] >= cur.end()) {
+        assign(cur, reg);
+        return true;
+      }
+      // free for a part of it, the rest looks for another place
+      uint32_t p = free_until[reg] & ~3;
+      if (p <= cur.start()) return false;
+      assign(cur, reg);
+      unhandled.emplace(p, split(i, p));
+      return true;
+    }
+
+    // the piece of interval i from pos on goes to the stack,
+    // and into a register again before its next use
+    void split_and_spill(uint32_t i, uint32_t pos) {
+      Interval &it = intervals[i];
+      // in a hole it can move at the end of the hole, a block boundary
+      uint32_t p = it.covers(pos) ? pos & ~3 : it.ranges[it.find(pos)].first;
+      uint32_t child = p <= intervals[i].start() ? i : split(i, p);
+      spill(intervals[child]);
+      uint32_t u = intervals[child].next_use(pos + 1);
+      while (u != none && (u & ~3) <= pos) u = intervals[child].next_use(u + 1);
+      if (u != none) unhandled.emplace(u & ~3, split(child, u & ~3));
+    }
+
+    void allocate_blocked(uint32_t i) {
+      Interval &cur = intervals[i];
+      uint32_t next_use[16] = {}, block_pos[16] = {};
+      for (int r: allocatable) next_use[r] = block_pos[r] = clobbered(r, cur);
+      for (uint32_t x: active) {
+        int r = intervals[x].loc.n;
+        next_use[r] = std::min(next_use[r], intervals[x].next_use(cur.start()));
+      }
+      for (uint32_t x: inactive) {
+        int r = intervals[x].loc.n;
+        if (intervals[x].intersection(cur, cur.start()) != none) {
+          next_use[r] = std::min(next_use[r], intervals[x].next_use(cur.start()));
+        }
+      }
+      int reg = allocatable[0];
+      for (int r: allocatable) {
+        if (next_use[r] > next_use[reg]) reg = r;
+      }
+      uint32_t first = cur.next_use(cur.start());
+      if (first == none || first > next_use[reg] || (block_pos[reg] < cur.end() && (block_pos[reg] & ~3) <= cur.start())) {
+        // every register is needed before cur is, so cur waits on the stack
+        spill(cur);
+        if (first != none && (first & ~3) > cur.start()) unhandled.emplace(first & ~3, split(i, first & ~3));
+        return;
+      }
+      assign(cur, reg);
+      if (block_pos[reg] < cur.end()) unhandled.emplace(block_pos[reg] & ~3, split(i, block_pos[reg] & ~3));
+      // whatever else is in reg moves out of the way
+      for (size_t k = 0; k < active.size();) {
+        if (intervals[active[k]].loc.n == reg) {
+          split_and_spill(active[k], cur.start());
+          active.erase(active.begin() + k);
+        } else {
+          k++;
+        }
+      }
+      for (size_t k = 0; k < inactive.size();) {
+        Interval &x = intervals[inactive[k]];
+        if (x.loc.n == reg && x.intersection(cur, cur.start()) != none) {
+          split_and_spill(inactive[k], cur.start());
+          inactive.erase(inactive.begin() + k);
+        } else {
+          k++;
+        }
+      }
+    }
+
+    void scan() {
+      for (uint32_t i = 0; i < intervals.size(); i++) unhandled.emplace(intervals[i].start(), i);
+      while (!unhandled.empty()) {
+        uint32_t p = unhandled.top().first, i = unhandled.top().second;
+        unhandled.pop();
+        for (size_t k = 0; k < active.size();) {
+          Interval &x = intervals[active[k]];
+          if (x.end() <= p || !x.covers(p)) {
+            if (x.end() > p) inactive.push_back(active[k]);
+            active[k] = active.back();
+            active.pop_back();
+          } else {
+            k++;
+          }
+        }
+        for (size_t k = 0; k < inactive.size();) {
+          Interval &x = intervals[inactive[k]];
+          if (x.end() <= p || x.covers(p)) {
+            if (x.end() > p) active.push_back(inactive[k]);
+            inactive[k] = inactive.back();
+            inactive.pop_back();
+          } else {
+            k++;
+          }
+        }
+        if (!try_allocate_free(i)) allocate_blocked(i);
+        if (intervals[i].loc.kind == Loc::Reg) active.push_back(i);
+      }
+    }
+
+    bool is_block_begin(uint32_t p) {
+      return std::binary_search(a.block_begin.begin(), a.block_begin.end(), p);
+    }
+
+    void resolve() {
+      a.pieces.assign(f.insts.size(), {});
+      for (Interval &it: intervals) a.pieces[it.value].push_back({it.start(), it.end(), it.loc});
+      for (uint32_t v = 0; v < f.insts.size(); v++) {
+        std::vector<Allocation::Piece> &ps = a.pieces[v];
+        std::sort(ps.begin(), ps.end(), [](const Allocation::Piece &x, const Allocation::Piece &y) {
+          return x.start < y.start;
+        });
+        for (size_t k = 1; k < ps.size(); k++) {
+          if (ps[k - 1].end == ps[k].start && !is_block_begin(ps[k].start) && ps[k - 1].loc != ps[k].loc) {
+            a.moves.emplace_back(ps[k].start, Move(ps[k].loc, ps[k - 1].loc, v));
+          }
+        }
+      }
+      std::stable_sort(a.moves.begin(), a.moves.end(), [](auto &x, auto &y) { return x.first < y.first; });
+
+      a.entry_moves.assign(f.blocks.size(), {});
+      a.exit_moves.assign(f.blocks.size(), {});
+      for (uint32_t s = 0; s < f.blocks.size(); s++) {
+        uint32_t begin = a.block_begin[s];
+        for (uint32_t k = 0; k < f.blocks[s].preds.size(); k++) {
+          uint32_t b = f.blocks[s].preds[k], end = a.block_begin[b + 1] - 1;
+          std::vector<Move> &moves = f.blocks[b].succs.size() == 1 ? a.exit_moves[b] : a.entry_moves[s];
+          for (uint32_t v: live_in[s]) {
+            Loc src = a.at(v, end), dst = a.at(v, begin);
+            if (src != dst) moves.emplace_back(dst, src, v);
+          }
+          for (uint32_t v: f.blocks[s].insts) {
+            if (f.insts[v].op != Inst::Phi) break;
+            uint32_t op = f.insts[v].ops[k];
+            Loc src = is_allocated(op) ? a.at(op, end) : Loc(), dst = a.at(v, begin);
+            if (src != dst && f.insts[op].op != Inst::Undef) moves.emplace_back(dst, src, op);
+          }
+        }
+      }
+      for (int r = 0; r < 16; r++) {
+        if (used[r] && std::find(std::begin(caller_saved), std::end(caller_saved), r) == std::end(caller_saved)) {
+          a.saved.push_back(r);
+        }
+      }
+    }
+
+    void allocate() {
+      number();
+      compute_live_in();
+      build_intervals();
+      set_hints();
+      scan();
+      resolve();
+    }
+  };
+
+  Allocation allocate_registers(Func &f) {
+    Allocation a;
+    Allocator(f, a).allocate();
+    return a;
+  }
+}
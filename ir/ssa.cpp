@@ -0,0 +1,269 @@
+#include "./ir.hpp"
+
+namespace ir {
+  // everything here walks the graph with explicit stacks,
+  // an elif chain makes both the CFG and the dominator tree as deep as it is long
+
+  DomTree::DomTree(Func &f)
+  : rpo_index(f.blocks.size(), none), idom(f.blocks.size(), none),
+    children(f.blocks.size()), pre(f.blocks.size(), none), post(f.blocks.size(), none) {
+    // one DFS from the entry numbers the blocks in pre-order,
+    // with their parents in the DFS tree, and in post-order
+    std::vector<uint32_t> vertex = {0}, parent = {none}, num(f.blocks.size(), none), order;
+    std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 0}};
+    num[0] = 0;
+    while (!stack.empty()) {
+      auto &[b, i] = stack.back();
+      std::vector<uint32_t> &succs = f.blocks[b].succs;
+      if (i < succs.size()) {
+        // the last successor first, so the first one comes first in the order
+        uint32_t s = succs[succs.size() - 1 - i++];
+        if (num[s] == none) {
+          num[s] = vertex.size();
+          vertex.push_back(s);
+          parent.push_back(num[b]);
+          stack.push_back({s, 0});
+        }
+        continue;
+      }
+      order.push_back(b);
+      stack.pop_back();
+    }
+    rpo.assign(order.rbegin(), order.rend());
+    for (uint32_t i = 0; i < rpo.size(); i++) rpo_index[rpo[i]] = i;
+
+    // Semi-NCA, "Finding Dominators in Practice", Georgiadis et al.
+    // unlike the iterative algorithm it stays near linear when a block
+    // has many predecessors deep in the tree, as the end of an elif chain
+    // all numbers below are pre-order numbers
+    uint32_t n = vertex.size();
+    std::vector<uint32_t> semi(n), label(n), ancestor(n, none), dom(parent), path;
+    for (uint32_t i = 0; i < n; i++) semi[i] = label[i] = i;
+    for (uint32_t w = n - 1; w > 0; w--) {
+      for (uint32_t p: f.blocks[vertex[w]].preds) {
+        uint32_t v = num[p];
+        if (v == none) continue;
+        // eval with path compression, without recursion
+        if (ancestor[v] != none) {
+          for (uint32_t u = v; ancestor[ancestor[u]] != none; u = ancestor[u]) path.push_back(u);
+          for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            uint32_t u = *it, a = ancestor[u];
+            if (semi[label[a]] < semi[label[u]]) label[u] = label[a];
+            ancestor[u] = ancestor[a];
+          }
+          path.clear();
+          v = label[v];
+        }
+        semi[w] = std::min(semi[w], semi[v]);
+      }
+      ancestor[w] = parent[w];
+    }
+    for (uint32_t w = 1; w < n; w++) {
+      while (dom[w] > semi[w]) dom[w] = dom[dom[w]];
+      idom[vertex[w]] = vertex[dom[w]];
+    }
+    idom[0] = none;
+    for (uint32_t b: rpo) {
+      if (idom[b] != none) children[idom[b]].push_back(b);
+    }
+
+    // numbers of the tree walk answer dominates in constant time
+    uint32_t count = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> walk = {{0, 0}};
+    pre[0] = count++;
+    while (!walk.empty()) {
+      auto &[b, i] = walk.back();
+      if (i < children[b].size()) {
+        uint32_t c = children[b][i++];
+        pre[c] = count++;
+        walk.push_back({c, 0});
+        continue;
+      }
+      post[b] = count++;
+      walk.pop_back();
+    }
+  }
+
+  bool DomTree::dominates(uint32_t a, uint32_t b) {
+    if (pre[a] == none || pre[b] == none) return false;
+    return pre[a] <= pre[b] && post[b] <= post[a];
+  }
+
+  // keeps the blocks reachable from the entry in reverse post-order,
+  // which is also the order they are emitted in
+  void sort_blocks(Func &f) {
+    DomTree dom(f);
+    std::vector<Block> blocks;
+    for (uint32_t b: dom.rpo) blocks.push_back(std::move(f.blocks[b]));
+    f.blocks = std::move(blocks);
+    for (Block &b: f.blocks) {
+      for (uint32_t &t: f.insts[b.terminator()].targets) {
+        if (t != none) t = dom.rpo_index[t];
+      }
+    }
+    f.link_blocks();
+  }
+
+  // an edge from a block with several successors to one with several
+  // predecessors gets a block of its own, where the copies for phis go
+  void split_critical_edges(Func &f) {
+    uint32_t n = f.blocks.size();
+    for (uint32_t b = 0; b < n; b++) {
+      if (f.blocks[b].succs.size() < 2) continue;
+      uint32_t t = f.blocks[b].terminator();
+      for (uint32_t i = 0; i < 2; i++) {
+        uint32_t target = f.insts[t].targets[i];
+        if (f.blocks[target].preds.size() < 2) continue;
+        uint32_t mid = f.add_block();
+        Inst jmp(Inst::Jmp, nullptr);
+        jmp.targets[0] = target;
+        f.insts.push_back(std::move(jmp));
+        f.blocks[mid].insts.push_back(f.insts.size() - 1);
+        f.insts[t].targets[i] = mid;
+      }
+    }
+    f.link_blocks();
+  }
+
+  // promotes the slots, which are never addressed, with phis
+  // at the iterated dominance frontiers of their stores
+  // only slots read in a block before being written there need phis
+  // (semi-pruned SSA, Briggs et al.)
+  void promote_slots(Func &f) {
+    DomTree dom(f);
+    uint32_t num_blocks = f.blocks.size(), num_slots = f.slots.size();
+
+    std::vector<std::vector<uint32_t>> frontier(num_blocks);
+    for (uint32_t b = 0; b < num_blocks; b++) {
+      if (f.blocks[b].preds.size() < 2) continue;
+      for (uint32_t p: f.blocks[b].preds) {
+        // a block already holding b was reached by an earlier walk,
+        // which went on up to the dominator of b
+        for (uint32_t r = p; r != dom.idom[b]; r = dom.idom[r]) {
+          if (!frontier[r].empty() && frontier[r].back() == b) break;
+          frontier[r].push_back(b);
+        }
+      }
+    }
+
+    std::vector<std::vector<uint32_t>> def_blocks(num_slots);
+    std::vector<bool> is_global(num_slots);
+    std::vector<uint32_t> written_in(num_slots, none);
+    for (uint32_t b = 0; b < num_blocks; b++) {
+      for (uint32_t v: f.blocks[b].insts) {
+        Inst &inst = f.insts[v];
+        if (inst.slot == none) continue;
+        if (inst.op == Inst::Store) {
+          if (written_in[inst.slot] != b) def_blocks[inst.slot].push_back(b);
+          written_in[inst.slot] = b;
+        } else if (written_in[inst.slot] != b) {
+          is_global[inst.slot] = true;
+        }
+      }
+    }
+
+    // the phis of each block, as (slot, value)
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> phis(num_blocks);
+    std::vector<uint32_t> has_phi(num_blocks, none), queued(num_blocks, none);
+    for (uint32_t s = 0; s < num_slots; s++) {
+      if (!is_global[s]) continue;
+      std::vector<uint32_t> work = def_blocks[s];
+      for (uint32_t b: work) queued[b] = s;
+      while (!work.empty()) {
+        uint32_t b = work.back();
+        work.pop_back();
+        for (uint32_t d: frontier[b]) {
+          if (has_phi[d] == s) continue;
+          has_phi[d] = s;
+          Inst phi(Inst::Phi, f.slots[s].type);
+          phi.ops.assign(f.blocks[d].preds.size(), none);
+          f.insts.push_back(std::move(phi));
+          phis[d].push_back({s, (uint32_t)f.insts.size() - 1});
+          if (queued[d] != s) {
+            queued[d] = s;
+            work.push_back(d);
+          }
+        }
+      }
+    }
+
+    // rename along the dominator tree, the current value of each
+    // slot is the top of its stack
+    std::vector<std::vector<uint32_t>> values(num_slots);
+    std::vector<uint32_t> undefs(num_slots, none);
+    std::vector<uint32_t> repl(f.insts.size(), none);
+    std::vector<std::pair<uint32_t, uint32_t>> pushed; // (slot, block)
+    auto current = [&](uint32_t s) {
+      if (!values[s].empty()) return values[s].back();
+      if (undefs[s] == none) {
+        f.insts.emplace_back(Inst::Undef, f.slots[s].type);
+        undefs[s] = f.insts.size() - 1;
+      }
+      return undefs[s];
+    };
+    auto rename_block = [&](uint32_t b) {
+      for (auto [s, phi]: phis[b]) {
+        values[s].push_back(phi);
+        pushed.push_back({s, b});
+      }
+      std::vector<uint32_t> kept;
+      for (uint32_t v: f.blocks[b].insts) {
+        Inst &inst = f.insts[v];
+        for (uint32_t &op: inst.ops) {
+          if (repl[op] != none) op = repl[op];
+        }
+        if (inst.slot == none) {
+          kept.push_back(v);
+        } else if (inst.op == Inst::Load) {
+          repl[v] = current(inst.slot);
+        } else {
+          values[inst.slot].push_back(inst.ops[0]);
+          pushed.push_back({inst.slot, b});
+        }
+      }
+      f.blocks[b].insts = std::move(kept);
+      for (uint32_t k = 0; k < f.blocks[b].succs.size(); k++) {
+        uint32_t succ = f.blocks[b].succs[k], j = f.blocks[b].pred_index[k];
+        for (auto [s, phi]: phis[succ]) f.insts[phi].ops[j] = current(s);
+      }
+    };
+    std::vector<std::pair<uint32_t, uint32_t>> walk = {{0, 0}};
+    rename_block(0);
+    while (!walk.empty()) {
+      auto &[b, i] = walk.back();
+      if (i < dom.children[b].size()) {
+        uint32_t c = dom.children[b][i++];
+        rename_block(c);
+        walk.push_back({c, 0});
+        continue;
+      }
+      while (!pushed.empty() && pushed.back().second == b) {
+        values[pushed.back().first].pop_back();
+        pushed.pop_back();
+      }
+      walk.pop_back();
+    }
+
+    for (uint32_t b = 0; b < num_blocks; b++) {
+      if (phis[b].empty()) continue;
+      std::vector<uint32_t> insts;
+      for (auto [s, phi]: phis[b]) insts.push_back(phi);
+      insts.insert(insts.end(), f.blocks[b].insts.begin(), f.blocks[b].insts.end());
+      f.blocks[b].insts = std::move(insts);
+    }
+    std::vector<uint32_t> entry;
+    for (uint32_t u: undefs) {
+      if (u != none) entry.push_back(u);
+    }
+    entry.insert(entry.end(), f.blocks[0].insts.begin(), f.blocks[0].insts.end());
+    f.blocks[0].insts = std::move(entry);
+    f.slots.clear();
+  }
+
+  void build_ssa(Func &f) {
+    sort_blocks(f);
+    split_critical_edges(f);
+    sort_blocks(f);
+    promote_slots(f);
+  }
+}
@@ -0,0 +1,165 @@
+#include "./ir.hpp"
+
+namespace ir {
+  class Verifier {
+    public:
+    Func &f;
+    bool ssa;
+    std::vector<std::string> &errors;
+    size_t num_errors;
+    Verifier(Func &fn, bool s, std::vector<std::string> &e)
+    : f(fn), ssa(s), errors(e), num_errors(e.size()) {}
+
+    void error(uint32_t b, const std::string &message) {
+      errors.push_back(std::string(f.name.sv) + ": b" + std::to_string(b) + ": " + message);
+    }
+
+    bool is_integer(uint32_t v) {
+      EvalType *t = f.insts[v].type;
+      return t && t->kind == EvalType::Num;
+    }
+
+    // the number of value operands each op takes, -1 for any
+    static int num_operands(Inst &inst) {
+      switch (inst.op) {
+      case Inst::Const: case Inst::Undef: case Inst::Arg: case Inst::Global: case Inst::Jmp:
+        return 0;
+      case Inst::Load:
+        return inst.slot == none ? 1 : 0;
+      case Inst::Store:
+        return inst.slot == none ? 2 : 1;
+      case Inst::Add: case Inst::Sub: case Inst::Mul: case Inst::Div: case Inst::Mod:
+        return 2;
+      case Inst::Ext: case Inst::Br:
+        return 1;
+      case Inst::Call: case Inst::Phi: case Inst::Ret:
+        return -1;
+      }
+      return -1;
+    }
+
+    void verify_inst(uint32_t b, uint32_t v) {
+      Inst &inst = f.insts[v];
+      std::string name = "%" + std::to_string(v);
+      int n = num_operands(inst);
+      if (n >= 0 && (int)inst.ops.size() != n) {
+        error(b, name + " takes " + std::to_string(n) + " operands");
+        return;
+      }
+      for (uint32_t op: inst.ops) {
+        if (op >= f.insts.size() || !f.insts[op].has_result()) {
+          error(b, name + " uses a value that is not defined");
+          return;
+        }
+      }
+      if (inst.slot != none && inst.slot >= f.slots.size()) error(b, name + " uses a slot that does not exist");
+      switch (inst.op) {
+      case Inst::Add: case Inst::Sub: case Inst::Mul: case Inst::Div: case Inst::Mod:
+        if (!is_integer(inst.ops[0]) || !is_integer(inst.ops[1])) error(b, name + " has an operand that is not an integer");
+        break;
+      case Inst::Ext:
+        if (!is_integer(inst.ops[0]) || !inst.type || inst.type->kind != EvalType::Num) {
+          error(b, name + " extends something that is not an integer");
+        }
+        break;
+      case Inst::Call: {
+        EvalType *t = inst.ops.empty() ? nullptr : f.insts[inst.ops[0]].type;
+        if (!t || t->kind != EvalType::Func) {
+          error(b, name + " calls something that is not a function");
+        } else if (static_cast<TypeFunc *>(t)->type_args.size() + 1 != inst.ops.size()) {
+          error(b, name + " passes a wrong number of arguments");
+        }
+        break;
+      }
+      case Inst::Phi:
+        if (inst.ops.size() != f.blocks[b].preds.size()) error(b, name + " does not have a value for each predecessor");
+        break;
+      case Inst::Ret:
+        if (inst.ops.size() > 1) error(b, name + " returns more than one value");
+        break;
+      case Inst::Jmp: case Inst::Br:
+        for (int i = 0; i < (inst.op == Inst::Br ? 2 : 1); i++) {
+          if (inst.targets[i] >= f.blocks.size()) error(b, name + " jumps to a block that does not exist");
+        }
+        break;
+      default:
+        break;
+      }
+      if (ssa && inst.slot != none) error(b, name + " uses a slot in SSA form");
+    }
+
+    bool verify() {
+      if (f.blocks.empty()) {
+        error(0, "no entry block");
+        return false;
+      }
+      for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        std::vector<uint32_t> &insts = f.blocks[b].insts;
+        if (insts.empty() || !f.insts[insts.back()].is_terminator()) {
+          error(b, "does not end with a terminator");
+          continue;
+        }
+        bool phis_done = false;
+        for (uint32_t i = 0; i < insts.size(); i++) {
+          Inst &inst = f.insts[insts[i]];
+          if (i + 1 < insts.size() && inst.is_terminator()) error(b, "has a terminator in the middle");
+          if (inst.op != Inst::Phi) phis_done = true;
+          else if (phis_done) error(b, "has a phi after another instruction");
+          verify_inst(b, insts[i]);
+        }
+      }
+      if (errors.size() > num_errors) return false;
+
+      // preds and succs must agree with the terminators
+      std::vector<Block> blocks = f.blocks;
+      f.link_blocks();
+      for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        if (blocks[b].preds != f.blocks[b].preds || blocks[b].succs != f.blocks[b].succs ||
+            blocks[b].pred_index != f.blocks[b].pred_index) {
+          error(b, "has stale predecessors or successors");
+        }
+      }
+      f.blocks = std::move(blocks);
+      if (!f.blocks[0].preds.empty()) error(0, "the entry block has predecessors");
+      if (ssa) verify_dominance();
+      return errors.size() == num_errors;
+    }
+
+    // each value is defined once and before all of its uses
+    // a use in a phi is at the end of the predecessor it comes from
+    void verify_dominance() {
+      DomTree dom(f);
+      std::vector<uint32_t> def_block(f.insts.size(), none), def_index(f.insts.size());
+      for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        for (uint32_t i = 0; i < f.blocks[b].insts.size(); i++) {
+          uint32_t v = f.blocks[b].insts[i];
+          if (def_block[v] != none) error(b, "%" + std::to_string(v) + " is defined twice");
+          def_block[v] = b;
+          def_index[v] = i;
+        }
+      }
+      for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        if (dom.rpo_index[b] == none) continue; // nothing runs there
+        for (uint32_t i = 0; i < f.blocks[b].insts.size(); i++) {
+          Inst &inst = f.insts[f.blocks[b].insts[i]];
+          for (uint32_t j = 0; j < inst.ops.size(); j++) {
+            uint32_t op = inst.ops[j], d = def_block[op];
+            bool ok;
+            if (d == none) ok = false;
+            else if (inst.op == Inst::Phi) ok = dom.dominates(d, f.blocks[b].preds[j]);
+            else if (d == b) ok = def_index[op] < i;
+            else ok = dom.dominates(d, b);
+            if (!ok) {
+              error(b, "%" + std::to_string(f.blocks[b].insts[i]) + " uses %" +
+                std::to_string(op) + " where it is not defined");
+            }
+          }
+        }
+      }
+    }
+  };
+
+  bool verify(Func &f, bool ssa, std::vector<std::string> &errors) {
+    return Verifier(f, ssa, errors).verify();
+  }
+}
@@ -1,18 +1,121 @@
 #include "bits/stdc++.h"
 #include "l4tc.hpp"
 
-int main() {
-  std::ostringstream ost;
-  ost << std::cin.rdbuf();
-  std::string source = ost.str();
-  tokenizer::Token *token_list = tokenizer::tokenize(source);
-  parser::Error error = parser::Error("", "", NULL);
-  std::shared_ptr<parser::AST> ast = parser::parse(&token_list, error);
-  if (!ast) {
-    std::cerr << error.get_error_string() << std::endl;
-    parser::print_ast(ast);
+class Options {
+  public:
+  const char *output;
+  bool stream;
+  int jobs; // threads for lexing and parsing
+  // 0 and 1 generate code straight from the tree, on the stack and in
+  // registers; 2 and above go through the IR; 1 and above fold it and
+  // remove its dead code first
+  int opt_level;
+  bool emit_ir; // the IR is written instead of assembly
+  std::vector<const char *> inputs;
+  Options() : output(NULL), stream(false), jobs(1), opt_level(2), emit_ir(false) {}
+};
+
+// each source is compiled on its own, its assembly is appended to os
+// path is NULL for stdin
+bool compile(std::string_view source, const char *path, std::ostream &os, Options &opts) {
+  tokenizer::LineTable lines;
+  lines.path = path;
+  tokenizer::NameTable names;
+  parser::Error error;
+  // the whole tree is freed with it at the end of compile
+  parser::Arena arena;
+  parser::AST *ast;
+  if (opts.stream) {
+    // lexing and parsing interleave, only a window of 64 tokens is kept
+    // the parser looks one token ahead and copies any token it keeps
+    // past the next one, so 4 would do; 64 leave room to spare and still
+    // fit in 1.5 KiB
+    tokenizer::TokenStream tokens(source, lines, names, 6);
+    ast = parser::parse(tokens, arena, error);
   } else {
-    // parser::print_ast(ast);
-    std::cout << generator::generate(ast) << std::endl;
+    std::vector<tokenizer::Token> tokens = tokenizer::tokenize(source, lines, names, opts.jobs);
+    ast = parser::parse(tokens, arena, error, opts.jobs);
+  }
+  if (!ast) {
+    std::cerr << error.get_error_string(lines) << std::endl;
+    return false;
+  }
+  // parser::print_ast(ast);
+  generator::TypeContext types;
+  std::vector<generator::Diagnostic> diags;
+  if (!generator::check(ast, names, types, diags)) {
+    for (generator::Diagnostic &d: diags) std::cerr << d.get_error_string(lines) << std::endl;
+    return false;
+  }
+  if (opts.opt_level >= 1) {
+    generator::fold(ast, arena);
+    generator::remove_dead_code(ast);
+  }
+  if (opts.opt_level < 2 && !opts.emit_ir) {
+    os << generator::generate(ast, opts.opt_level == 1) << std::endl;
+    return true;
+  }
+  std::string out;
+  std::vector<std::string> ir_errors;
+  if (!ir::generate(ast, types, opts.emit_ir, out, ir_errors)) {
+    for (std::string &e: ir_errors) std::cerr << "l4tc: broken IR: " << e << std::endl;
+    return false;
+  }
+  os << out << std::endl;
+  return true;
+}
+
+// usage: l4tc [-o out.S] [--stream] [-j N] [-O0|-O1|-O2] [--emit-ir] [file...]
+// source is read from stdin when no file is given
+int main(int argc, char **argv) {
+  Options opts;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "-o") {
+      if (++i == argc) {
+        std::cerr << "l4tc: -o needs a file name" << std::endl;
+        return 1;
+      }
+      opts.output = argv[i];
+    } else if (arg == "-j") {
+      if (++i == argc || atoi(argv[i]) < 1) {
+        std::cerr << "l4tc: -j needs a positive number" << std::endl;
+        return 1;
+      }
+      opts.jobs = atoi(argv[i]);
+    } else if (arg == "--stream") {
+      opts.stream = true;
+    } else if (arg.substr(0, 2) == "-O" && arg.size() == 3 && isdigit(arg[2])) {
+      opts.opt_level = arg[2] - '0';
+    } else if (arg == "--emit-ir") {
+      opts.emit_ir = true;
+    } else {
+      opts.inputs.push_back(argv[i]);
+    }
+  }
+
+  std::ofstream ofs;
+  if (opts.output) {
+    ofs.open(opts.output);
+    if (!ofs) {
+      std::cerr << "l4tc: cannot open " << opts.output << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &os = opts.output ? ofs : std::cout;
+
+  if (opts.inputs.empty()) {
+    tokenizer::Source src;
+    tokenizer::read_source(src, std::cin);
+    return compile(src.sv, NULL, os, opts) ? 0 : 1;
+  }
+  for (const char *path: opts.inputs) {
+    tokenizer::Source src;
+    if (!tokenizer::open_source(src, path)) {
+      std::cerr << "l4tc: cannot open " << path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    if (!compile(src.sv, path, os, opts)) return 1;
   }
-}
\ No newline at end of file
+  return 0;
+}
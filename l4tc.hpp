@@ -4,4 +4,5 @@
 #include "./tokenizer/tokenizer.hpp"
 #include "./parser/parser.hpp"
 #include "./generator/generator.hpp"
+#include "./ir/ir.hpp"
 #endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "./parser.hpp"
+
+namespace parser {
+  // fields of each kind in FlatAST
+  //   TypeSpec, SimpleExpr                   token
+  //   Declarator                             token, lhs: init or none
+  //   PrimaryExpr, ExprStmt, ReturnStmt      lhs: expr
+  //   FuncCallExpr                           lhs: primary, rhs: list of args
+  //   binary exprs                           token: operator, lhs, rhs
+  //   Declaration, ExternalDeclaration       lhs: type spec, rhs: list of declarators
+  //   SimpleDeclaration                      lhs: type spec, rhs: declarator
+  //   CompoundStmt, TranslationUnit          rhs: list of items
+  //   IfStmt, ElseStmt                       lhs: cond or none,
+  //                                          rhs: list of true stmt and false stmt
+  //   FuncDeclarator                         lhs: declarator, rhs: list of args
+  //   FuncDeclaration                        lhs: type spec, rhs: func declarator
+  //   FuncDef                                lhs: declaration, rhs: body
+  //   BreakStmt, ContinueStmt                token
+  class Flattener : public Visitor<Flattener, uint32_t> {
+    public:
+    FlatAST &ast;
+    std::vector<Token> &source_tokens;
+    Flattener(FlatAST &a, std::vector<Token> &t) : ast(a), source_tokens(t) {}
+
+    uint32_t token_index(Token &t) {
+      // tokens are sorted by their position in the source
+      return std::lower_bound(
+        source_tokens.begin(), source_tokens.end(), t.sv.data(),
+        [](Token &u, const char *p) { return u.sv.data() < p; }
+      ) - source_tokens.begin();
+    }
+
+    uint32_t push(AST *n, uint32_t token, uint32_t l, uint32_t r) {
+      ast.kinds.push_back(n->kind);
+      ast.tokens.push_back(token);
+      ast.lhs.push_back(l);
+      ast.rhs.push_back(r);
+      return ast.size() - 1;
+    }
+
+    uint32_t visit_or_none(AST *n) {
+      return n ? visit(n) : FlatAST::none;
+    }
+
+    // children are visited first, the list is stored after them
+    template <class T> uint32_t push_list(std::vector<T *> &v) {
+      std::vector<uint32_t> items;
+      items.reserve(v.size());
+      for (T *n: v) items.push_back(visit(n));
+      ast.extra.push_back(items.size());
+      ast.extra.insert(ast.extra.end(), items.begin(), items.end());
+      return ast.extra.size() - items.size() - 1;
+    }
+
+    uint32_t push_pair(uint32_t a, uint32_t b) {
+      ast.extra.push_back(2);
+      ast.extra.push_back(a);
+      ast.extra.push_back(b);
+      return ast.extra.size() - 3;
+    }
+
+    uint32_t visit_type_spec(ASTTypeSpec *n) {
+      return push(n, token_index(n->op), FlatAST::none, FlatAST::none);
+    }
+    uint32_t visit_simple_expr(ASTSimpleExpr *n) {
+      return push(n, token_index(n->op), FlatAST::none, FlatAST::none);
+    }
+    uint32_t visit_declarator(ASTDeclarator *n) {
+      uint32_t l = visit_or_none(n->init);
+      return push(n, token_index(n->op), l, FlatAST::none);
+    }
+    uint32_t visit_primary_expr(ASTPrimaryExpr *n) {
+      uint32_t l = visit(n->expr);
+      return push(n, FlatAST::none, l, FlatAST::none);
+    }
+    uint32_t visit_func_call_expr(ASTFuncCallExpr *n) {
+      uint32_t l = visit(n->primary);
+      uint32_t r = push_list(n->args);
+      return push(n, FlatAST::none, l, r);
+    }
+    uint32_t visit_binary_expr(ASTExpr *n) {
+      uint32_t l = visit(n->left);
+      uint32_t r = visit(n->right);
+      return push(n, token_index(binary_operator(n)), l, r);
+    }
+    uint32_t visit_expr_stmt(ASTExprStmt *n) {
+      uint32_t l = visit(n->expr);
+      return push(n, FlatAST::none, l, FlatAST::none);
+    }
+    uint32_t visit_return_stmt(ASTReturnStmt *n) {
+      uint32_t l = visit(n->expr);
+      return push(n, FlatAST::none, l, FlatAST::none);
+    }
+    uint32_t visit_break_stmt(ASTBreakStmt *n) {
+      return push(n, token_index(n->op), FlatAST::none, FlatAST::none);
+    }
+    uint32_t visit_continue_stmt(ASTContinueStmt *n) {
+      return push(n, token_index(n->op), FlatAST::none, FlatAST::none);
+    }
+    uint32_t visit_declaration(ASTDeclaration *n) {
+      uint32_t l = visit(n->declaration_spec);
+      uint32_t r = push_list(n->declarators);
+      return push(n, FlatAST::none, l, r);
+    }
+    uint32_t visit_external_declaration(ASTExternalDeclaration *n) {
+      uint32_t l = visit(n->declaration_spec);
+      uint32_t r = push_list(n->declarators);
+      return push(n, FlatAST::none, l, r);
+    }
+    uint32_t visit_simple_declaration(ASTSimpleDeclaration *n) {
+      uint32_t l = visit(n->type_spec);
+      uint32_t r = visit(n->declarator);
+      return push(n, FlatAST::none, l, r);
+    }
+    uint32_t visit_comp_stmt(ASTCompoundStmt *n) {
+      uint32_t r = push_list(n->items);
+      return push(n, FlatAST::none, FlatAST::none, r);
+    }
+    uint32_t visit_if_stmt(ASTIfStmt *n) {
+      uint32_t l = visit(n->cond);
+      uint32_t t = visit(n->true_stmt);
+      uint32_t f = visit_or_none(n->false_stmt);
+      return push(n, FlatAST::none, l, push_pair(t, f));
+    }
+    uint32_t visit_else_stmt(ASTElseStmt *n) {
+      uint32_t l = visit_or_none(n->cond);
+      uint32_t t = visit(n->true_stmt);
+      uint32_t f = visit_or_none(n->false_stmt);
+      return push(n, FlatAST::none, l, push_pair(t, f));
+    }
+    uint32_t visit_func_declarator(ASTFuncDeclarator *n) {
+      uint32_t l = visit(n->declarator);
+      uint32_t r = push_list(n->args);
+      return push(n, FlatAST::none, l, r);
+    }
+    uint32_t visit_func_declaration(ASTFuncDeclaration *n) {
+      uint32_t l = visit(n->type_spec);
+      uint32_t r = visit(n->declarator);
+      return push(n, FlatAST::none, l, r);
+    }
+    uint32_t visit_func_def(ASTFuncDef *n) {
+      uint32_t l = visit(n->declaration);
+      uint32_t r = visit(n->body);
+      return push(n, FlatAST::none, l, r);
+    }
+    uint32_t visit_translation_unit(ASTTranslationUnit *n) {
+      uint32_t r = push_list(n->external_declarations);
+      return push(n, FlatAST::none, FlatAST::none, r);
+    }
+  };
+
+  FlatAST flatten(AST *root, std::vector<Token> &tokens) {
+    FlatAST ret;
+    Flattener(ret, tokens).visit(root);
+    return ret;
+  }
+
+  // one line per node in the order of the arrays
+  void print_flat_ast(FlatAST &ast, std::vector<Token> &tokens) {
+    for (uint32_t i = 0; i < ast.size(); i++) {
+      std::cerr << i << ": kind=" << (int)ast.kinds[i];
+      if (ast.tokens[i] != FlatAST::none) std::cerr << " token=" << tokens[ast.tokens[i]].sv;
+      if (ast.lhs[i] != FlatAST::none) std::cerr << " lhs=" << ast.lhs[i];
+      if (ast.rhs[i] != FlatAST::none) std::cerr << " rhs=" << ast.rhs[i];
+      std::cerr << std::endl;
+    }
+  }
+}
@@ -1,470 +1,468 @@
 #include "./parser.hpp"
 
 namespace parser {
-  std::shared_ptr<ASTTypeSpec> parse_type_spec(Token **next, Error &err) {
+  ASTTypeSpec *parse_type_spec(TokenIter &next, Error &err, Arena &arena) {
     Token *t;
     if (
       (t = expect_token_with_type(next, err, KwNum)) ||
+      (t = expect_token_with_type(next, err, KwInt)) ||
       (t = expect_token_with_type(next, err, KwStr))
     ) {
-      return std::make_shared<ASTTypeSpec>(t);
+      return arena.make<ASTTypeSpec>(t);
     }
     return nullptr;
   }
 
-  std::shared_ptr<ASTTypeSpec> parse_declaration_spec(Token **next, Error &err) {
-    return parse_type_spec(next, err);
+  ASTTypeSpec *parse_declaration_spec(TokenIter &next, Error &err, Arena &arena) {
+    return parse_type_spec(next, err, arena);
   }
 
-  std::shared_ptr<ASTExpr> parse_expr(Token **next, Error &err);
-  std::shared_ptr<ASTExpr> parse_primary_expr(Token **next, Error &err) {
-    Token *t;
-    if (expect_token_with_str(next, err, "(")) {
-      std::shared_ptr<ASTPrimaryExpr> ret = std::make_shared<ASTPrimaryExpr>();
-      if (!(ret->expr = parse_expr(next, err))) return nullptr;
-      if (expect_token_with_str(next, err, ")")) return ret;
-    } else if (
-      (t = expect_token_with_type(next, err, NumberConstant)) ||
-      (t = expect_token_with_type(next, err, Ident))
-    ) {
-      return std::make_shared<ASTSimpleExpr>(t);
-    }
-    return nullptr;
-  }
-
-  std::shared_ptr<ASTExpr> parse_assign_expr(Token **next, Error &err);
-  std::shared_ptr<ASTExpr> parse_postfix_expr(Token **next, Error &err) {
-  // function-call
-  // array
-  // increment
-  // decrement
-  // ->
-  // .
-    std::shared_ptr<ASTExpr> primary = parse_primary_expr(next, err);
-    if (!primary) return nullptr;
-    // if "(" is not here, it is not function-call
-    // but it is correct primary expr
-    if (!expect_token_with_str(next, err, "(")) return primary;
-    // now it is function-call-expr
-    std::shared_ptr<ASTFuncCallExpr> ret = std::make_shared<ASTFuncCallExpr>();
-    ret->primary = primary;
-
-    std::shared_ptr<ASTExpr> arg;
-    while (!expect_token_with_str(next, err, ")")) {
-      if (!(arg = parse_assign_expr(next, err))) return nullptr;
-      ret->args.push_back(arg);
-      if (expect_token_with_str(next, err, ",")) continue;
-      // end
-      if (!expect_token_with_str(next, err, ")")) return nullptr;
-      break;
-    }
+  // binding powers of operators, 0 for other tokens
+  // ":" binds the weakest and is the only right-associative one
+  constexpr int assign_bp = 1;
+  constexpr std::array<int, num_token_types> create_binding_powers() {
+    std::array<int, num_token_types> ret = {};
+    ret[ColonTok] = assign_bp;
+    ret[BarBarTok] = 2;
+    ret[AmpAmpTok] = 3;
+    ret[BarTok] = 4;
+    ret[CaretTok] = 5;
+    ret[AmpTok] = 6;
+    ret[EqualEqualTok] = ret[NotEqualTok] = 7;
+    ret[LessTok] = ret[GreaterTok] = ret[LessEqualTok] = ret[GreaterEqualTok] = 8;
+    ret[LessLessTok] = ret[GreaterGreaterTok] = 9;
+    ret[PlusTok] = ret[MinusTok] = 10;
+    ret[StarTok] = ret[SlashTok] = ret[PercentTok] = 11;
     return ret;
   }
+  constexpr std::array<int, num_token_types> binding_powers = create_binding_powers();
 
-  std::shared_ptr<ASTExpr> parse_unary_expr(Token **next, Error &err) {
-    return parse_postfix_expr(next, err);
-  }
-
-  std::shared_ptr<ASTExpr> parse_multiplicative_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_unary_expr(next, err);
-    if (!ret) return nullptr;
-    Token *t;
-    while (
-      (t = expect_token_with_str(next, err, "*")) ||
-      (t = expect_token_with_str(next, err, "/")) ||
-      (t = expect_token_with_str(next, err, "%"))
-    ) {
-      left = ret;
-      ret = std::make_shared<ASTMultiplicativeExpr>(t);
-      ret->left = left;
-      if (!(ret->right = parse_unary_expr(next, err))) return nullptr;
-    }
+  std::bitset<num_token_types> create_binary_operators() {
+    std::bitset<num_token_types> ret;
+    for (int i = 0; i < num_token_types; i++) ret[i] = binding_powers[i] > assign_bp;
     return ret;
   }
-
-  std::shared_ptr<ASTExpr> parse_additive_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_multiplicative_expr(next, err);
-    if (!ret) return nullptr;
-    Token *t;
-    while (
-      (t = expect_token_with_str(next, err, "+")) ||
-      (t = expect_token_with_str(next, err, "-"))
-    ) {
-      left = ret;
-      ret = std::make_shared<ASTAdditiveExpr>(t);
-      ret->left = left;
-      if (!(ret->right = parse_multiplicative_expr(next, err))) return nullptr;
+  const std::bitset<num_token_types> binary_operators = create_binary_operators();
+
+  ASTExpr *create_operator_expr(Token *t, Arena &arena) {
+    switch (t->type) {
+    case StarTok: case SlashTok: case PercentTok:
+      return arena.make<ASTMultiplicativeExpr>(t);
+    case PlusTok: case MinusTok:
+      return arena.make<ASTAdditiveExpr>(t);
+    case LessLessTok: case GreaterGreaterTok:
+      return arena.make<ASTShiftExpr>(t);
+    case LessTok: case GreaterTok: case LessEqualTok: case GreaterEqualTok:
+      return arena.make<ASTRelationalExpr>(t);
+    case EqualEqualTok: case NotEqualTok:
+      return arena.make<ASTEqualityExpr>(t);
+    case AmpTok:
+      return arena.make<ASTBitwiseAndExpr>(t);
+    case CaretTok:
+      return arena.make<ASTBitwiseXorExpr>(t);
+    case BarTok:
+      return arena.make<ASTBitwiseOrExpr>(t);
+    case AmpAmpTok:
+      return arena.make<ASTLogicalAndExpr>(t);
+    case BarBarTok:
+      return arena.make<ASTLogicalOrExpr>(t);
+    default:
+      return arena.make<ASTAssignExpr>(t);
     }
-    return ret;
   }
 
-  std::shared_ptr<ASTExpr> parse_shift_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_additive_expr(next, err);
-    if (!ret) return nullptr;
-    Token *t;
-    while (
-      (t = expect_token_with_str(next, err, "<<")) ||
-      (t = expect_token_with_str(next, err, ">>"))
-    ) {
-      left = ret;
-      ret = std::make_shared<ASTShiftExpr>(t);
-      ret->left = left;
-      if (!(ret->right = parse_additive_expr(next, err))) return nullptr;
-    }
-    return ret;
-  }
+  // an operator waiting for its right operand (bp > 0),
+  // or an open parenthesis or function call (bp == 0)
+  // the token is copied, a TokenStream may have dropped it by the time
+  // the operator is reduced
+  class PendingOp {
+    public:
+    Token op;
+    int bp;
+    ASTFuncCallExpr *call; // NULL unless an open function call
+    PendingOp(Token *t, int b, ASTFuncCallExpr *c) : op(*t), bp(b), call(c) {}
+  };
+
+  // precedence climbing over explicit stacks instead of one function
+  // per precedence level; nesting of parentheses and calls grows the
+  // stacks, not the call stack
+  ASTExpr *parse_expr(TokenIter &next, Error &err, Arena &arena) {
+    std::vector<ASTExpr *> operands;
+    std::vector<PendingOp> ops;
+    // builds the nodes of pending operators binding tighter than bp
+    auto reduce = [&](int bp) {
+      while (!ops.empty() && ops.back().bp > bp) {
+        ASTExpr *ret = create_operator_expr(&ops.back().op, arena);
+        ops.pop_back();
+        ret->right = operands.back();
+        operands.pop_back();
+        ret->left = operands.back();
+        operands.back() = ret;
+      }
+    };
 
-  std::shared_ptr<ASTExpr> parse_relational_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_shift_expr(next, err);
-    if (!ret) return nullptr;
     Token *t;
-    while (
-      (t = expect_token_with_str(next, err, "<")) ||
-      (t = expect_token_with_str(next, err, ">")) ||
-      (t = expect_token_with_str(next, err, "<=")) ||
-      (t = expect_token_with_str(next, err, ">="))
-    ) {
-      left = ret;
-      ret = std::make_shared<ASTRelationalExpr>(t);
-      ret->left = left;
-      if (!(ret->right = parse_shift_expr(next, err))) return nullptr;
-    }
-    return ret;
-  }
+    while (1) {
+      // operand
+      if ((t = expect_token_with_type(next, err, LParenTok))) {
+        ops.emplace_back(t, 0, nullptr);
+        continue;
+      }
+      if (
+        !(t = expect_token_with_type(next, err, NumberConstant)) &&
+        !(t = expect_token_with_type(next, err, Ident))
+      ) {
+        return nullptr;
+      }
+      operands.push_back(arena.make<ASTSimpleExpr>(t));
+      // only a primary expr can be called
+      bool is_primary = true;
+
+      // what follows the operand
+      while (1) {
+        if (is_primary && (t = expect_token_with_type(next, err, LParenTok))) {
+          ASTFuncCallExpr *call = arena.make<ASTFuncCallExpr>();
+          call->primary = operands.back();
+          operands.pop_back();
+          if (expect_token_with_type(next, err, RParenTok)) {
+            operands.push_back(call);
+            is_primary = false;
+            continue;
+          }
+          ops.emplace_back(t, 0, call);
+          break;
+        }
 
-  std::shared_ptr<ASTExpr> parse_equality_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_relational_expr(next, err);
-    if (!ret) return nullptr;
-    Token *t;
-    while (
-      (t = expect_token_with_str(next, err, "==")) ||
-      (t = expect_token_with_str(next, err, "!="))
-    ) {
-      left = ret;
-      ret = std::make_shared<ASTEqualityExpr>(t);
-      ret->left = left;
-      if (!(ret->right = parse_relational_expr(next, err))) return nullptr;
+        t = *next;
+        int bp = t ? binding_powers[t->type] : 0;
+        if (bp > assign_bp) {
+          // left-associative
+          reduce(bp - 1);
+          ops.emplace_back(t, bp, nullptr);
+          ++next;
+          break;
+        }
+        // only a unary expr can be the left of ":"
+        bool is_assignable =
+          (ops.empty() || ops.back().bp <= assign_bp) && is_unary_expr(operands.back());
+        if (bp == assign_bp && is_assignable) {
+          ops.emplace_back(t, bp, nullptr);
+          ++next;
+          break;
+        }
+        std::bitset<num_token_types> expected = binary_operators;
+        if (is_assignable) expected.set(ColonTok);
+        err.expect(next, expected);
+
+        // the innermost parenthesis or call, or the whole expr ends here
+        reduce(0);
+        if (ops.empty()) return operands.back();
+        ASTFuncCallExpr *call = ops.back().call;
+        if (call && expect_token_with_type(next, err, CommaTok)) {
+          call->args.push_back(operands.back());
+          operands.pop_back();
+          // a comma may end the arguments
+          if (!expect_token_with_type(next, err, RParenTok)) break;
+          ops.pop_back();
+          operands.push_back(call);
+          is_primary = false;
+          continue;
+        }
+        if (!expect_token_with_type(next, err, RParenTok)) return nullptr;
+        ops.pop_back();
+        if (call) {
+          call->args.push_back(operands.back());
+          operands.back() = call;
+          is_primary = false;
+        } else {
+          ASTPrimaryExpr *primary = arena.make<ASTPrimaryExpr>();
+          primary->expr = operands.back();
+          operands.back() = primary;
+          is_primary = true;
+        }
+      }
     }
-    return ret;
   }
 
-  std::shared_ptr<ASTExpr> parse_bitwise_and_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_equality_expr(next, err);
-    if (!ret) return nullptr;
-    while (expect_token_with_str(next, err, "&")) {
-      left = ret;
-      ret = std::make_shared<ASTBitwiseAndExpr>();
-      ret->left = left;
-      if (!(ret->right = parse_equality_expr(next, err))) return nullptr;
-    }
-    return ret;
-  }
+  // the first tokens of statements and declarations other than expr-stmt
+  const std::bitset<num_token_types> stmt_keywords = std::bitset<num_token_types>()
+    .set(KwBreak).set(KwContinue).set(KwReturn).set(KwIf).set(KwNum).set(KwInt).set(KwStr);
 
-  std::shared_ptr<ASTExpr> parse_bitwise_xor_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_bitwise_and_expr(next, err);
-    if (!ret) return nullptr;
-    while (expect_token_with_str(next, err, "^")) {
-      left = ret;
-      ret = std::make_shared<ASTBitwiseXorExpr>();
-      ret->left = left;
-      if (!(ret->right = parse_bitwise_and_expr(next, err))) return nullptr;
-    }
+  AST *parse_expr_stmt(TokenIter &next, Error &err, Arena &arena, int) {
+    // chosen because no keyword matched
+    err.expect(next, stmt_keywords);
+    ASTExprStmt *ret = arena.make<ASTExprStmt>();
+    if (!(ret->expr = parse_expr(next, err, arena))) return nullptr;
+    if (!expect_token_with_type(next, err, LF)) return nullptr;
     return ret;
   }
 
-  std::shared_ptr<ASTExpr> parse_bitwise_or_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_bitwise_xor_expr(next, err);
-    if (!ret) return nullptr;
-    while (expect_token_with_str(next, err, "|")) {
-      left = ret;
-      ret = std::make_shared<ASTBitwiseOrExpr>();
-      ret->left = left;
-      if (!(ret->right = parse_bitwise_xor_expr(next, err))) return nullptr;
-    }
-    return ret;
+  ASTDeclarator *parse_declarator(TokenIter &next, Error &err, Arena &arena) {
+    Token *t = expect_token_with_type(next, err, Ident);
+    if (!t) return nullptr;
+    return arena.make<ASTDeclarator>(t);
   }
 
-  std::shared_ptr<ASTExpr> parse_logical_and_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_bitwise_or_expr(next, err);
-    if (!ret) return nullptr;
-    while (expect_token_with_str(next, err, "&&")) {
-      left = ret;
-      ret = std::make_shared<ASTLogicalAndExpr>();
-      ret->left = left;
-      if (!(ret->right = parse_bitwise_or_expr(next, err))) return nullptr;
-    }
-    return ret;
-  }
+  AST *parse_declaration(TokenIter &next, Error &err, Arena &arena, int) {
+    ASTDeclaration *ret = arena.make<ASTDeclaration>();
+    if (!(ret->declaration_spec = parse_declaration_spec(next, err, arena))) return nullptr;
 
-  std::shared_ptr<ASTExpr> parse_logical_or_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left, ret = parse_logical_and_expr(next, err);
-    if (!ret) return nullptr;
-    while (expect_token_with_str(next, err, "||")) {
-      left = ret;
-      ret = std::make_shared<ASTLogicalOrExpr>();
-      ret->left = left;
-      if (!(ret->right = parse_logical_and_expr(next, err))) return nullptr;
+    ASTDeclarator *declarator;
+    while ((declarator = parse_declarator(next, err, arena))) {
+      ret->declarators.push_back(declarator);
+      if (expect_token_with_type(next, err, CommaTok)) continue;
+      // declaration end
+      if (expect_token_with_type(next, err, LF)) return ret;
+      break;
     }
-    return ret;
+    return nullptr;
   }
 
-  std::shared_ptr<ASTExpr> parse_assign_expr(Token **next, Error &err) {
-    std::shared_ptr<ASTExpr> left = parse_logical_or_expr(next, err);
-    // parse error
-    if (!left) return nullptr;
-    // if it is not unary-expr, it can't be left of assignment-expr
-    // but it is correct expr
-    if (!is_unary_expr(left)) return left;
-    // if ":" is not here, it is not assignment-expr
-    // but it is correct expr
-    if (!expect_token_with_str(next, err, ":")) return left;
-    // now it is assignment-expr
-    std::shared_ptr<ASTAssignExpr> ret = std::make_shared<ASTAssignExpr>();
-    ret->left = left;
-    if (!(ret->right = parse_assign_expr(next, err))) return nullptr;
+  ASTSimpleDeclaration *parse_simple_declaration(TokenIter &next, Error &err, Arena &arena) {
+  // type-specifier declarator
+    ASTSimpleDeclaration *ret = arena.make<ASTSimpleDeclaration>();
+    if (!(ret->type_spec = parse_type_spec(next, err, arena))) return nullptr;
+    if (!(ret->declarator = parse_declarator(next, err, arena))) return nullptr;
     return ret;
   }
 
-  std::shared_ptr<ASTExpr> parse_expr(Token **next, Error &err) {
-    return parse_assign_expr(next, err);
-  }
+  ASTCompoundStmt *parse_comp_stmt(TokenIter &next, Error &err, Arena &arena, int indents);
 
-  std::shared_ptr<ASTExprStmt> parse_expr_stmt(Token **next, Error &err) {
-    std::shared_ptr<ASTExprStmt> ret = std::make_shared<ASTExprStmt>();
-    if (!(ret->expr = parse_expr(next, err))) return nullptr;
-    if (!expect_token_with_str(next, err, "\n")) return nullptr;
-    return ret;
+  // indents followed by elif or else
+  // it looks 2 tokens ahead, so the parser needs no backtracking here
+  bool is_else_stmt_next(TokenIter &next, int indents) {
+    Token *t = *next, *u;
+    if (!t || t->type != Indent || (int)t->sv.length() != indents) return false;
+    return (u = next.peek(1)) && (u->type == KwElif || u->type == KwElse);
   }
 
-  std::shared_ptr<ASTDeclarator> parse_declarator(Token **next, Error &err) {
-    Token *t = expect_token_with_type(next, err, Ident);
-    if (!t) return nullptr;
-    return std::make_shared<ASTDeclarator>(t);
-  }
+  // statements below are chosen by their first token,
+  // which they consume without matching it again
 
-  std::shared_ptr<ASTDeclaration> parse_declaration(Token **next, Error &err) {
-    std::shared_ptr<ASTDeclaration> ret = std::make_shared<ASTDeclaration>();
-    if (!(ret->declaration_spec = parse_declaration_spec(next, err))) return nullptr;
+  AST *parse_break_stmt(TokenIter &next, Error &err, Arena &arena, int) {
+    Token *t = *next;
+    ++next;
+    if (!expect_token_with_type(next, err, LF)) return nullptr;
+    return arena.make<ASTBreakStmt>(t);
+  }
 
-    std::shared_ptr<ASTDeclarator> declarator;
-    while ((declarator = parse_declarator(next, err))) {
-      ret->declarators.push_back(declarator);
-      if (expect_token_with_str(next, err, ",")) continue;
-      // declaration end
-      if (expect_token_with_str(next, err, "\n")) return ret;
-      break;
-    }
-    return nullptr;
+  AST *parse_continue_stmt(TokenIter &next, Error &err, Arena &arena, int) {
+    Token *t = *next;
+    ++next;
+    if (!expect_token_with_type(next, err, LF)) return nullptr;
+    return arena.make<ASTContinueStmt>(t);
   }
 
-  std::shared_ptr<ASTSimpleDeclaration> parse_simple_declaration(Token **next, Error &err) {
-  // type-specifier declarator
-    std::shared_ptr<ASTSimpleDeclaration> ret = std::make_shared<ASTSimpleDeclaration>();
-    if (!(ret->type_spec = parse_type_spec(next, err))) return nullptr;
-    if (!(ret->declarator = parse_declarator(next, err))) return nullptr;
+  AST *parse_return_stmt(TokenIter &next, Error &err, Arena &arena, int) {
+    ++next;
+    ASTReturnStmt *ret = arena.make<ASTReturnStmt>();
+    if (!(ret->expr = parse_expr(next, err, arena))) return nullptr;
+    if (!expect_token_with_type(next, err, LF)) return nullptr;
     return ret;
   }
 
-  std::shared_ptr<ASTCompoundStmt> parse_comp_stmt(Token **next, Error &err, int indents);
-
-  std::shared_ptr<ASTElseStmt> parse_else_stmt(Token **next, Error &err, int indents) {
-    std::shared_ptr<ASTElseStmt> ret = std::make_shared<ASTElseStmt>();
-    if (expect_token_with_type(next, err, KwElif)) {
-      if (!(ret->cond = parse_expr(next, err))) return nullptr;
-    } else if (!expect_token_with_type(next, err, KwElse)) {
-      return nullptr;
-    }
-    if (!expect_token_with_str(next, err, "\n")) return nullptr;
-    if (!(ret->true_stmt = parse_comp_stmt(next, err, indents + 2))) return nullptr;
-    Token *saved_token = *next;
-    if (!consume_token_with_indents(next, indents) ||
-        !(ret->false_stmt = parse_else_stmt(next, err, indents))
-    ) {
-      *next = saved_token;
-      return ret;
+  // if, then its chain of elif and else in a loop, not by recursion
+  AST *parse_if_stmt(TokenIter &next, Error &err, Arena &arena, int indents) {
+    ++next;
+    ASTIfStmt *ret = arena.make<ASTIfStmt>();
+    if (!(ret->cond = parse_expr(next, err, arena))) return nullptr;
+    if (!expect_token_with_type(next, err, LF)) return nullptr;
+    if (!(ret->true_stmt = parse_comp_stmt(next, err, arena, indents + 2))) return nullptr;
+    ASTElseStmt **tail = &ret->false_stmt;
+    while (is_else_stmt_next(next, indents)) {
+      // indents
+      ++next;
+      ASTElseStmt *else_stmt = arena.make<ASTElseStmt>();
+      if ((*next)->type == KwElif) {
+        ++next;
+        if (!(else_stmt->cond = parse_expr(next, err, arena))) return nullptr;
+      } else {
+        ++next;
+      }
+      if (!expect_token_with_type(next, err, LF)) return nullptr;
+      if (!(else_stmt->true_stmt = parse_comp_stmt(next, err, arena, indents + 2))) return nullptr;
+      *tail = else_stmt;
+      tail = &else_stmt->false_stmt;
     }
     return ret;
   }
 
-  std::shared_ptr<AST> parse_stmt(Token **next, Error &err, int indents) {
-    if (expect_token_with_type(next, err, KwBreak)) {
-      if (!expect_token_with_str(next, err, "\n")) return nullptr;
-      return std::make_shared<ASTBreakStmt>();
-    }
-    if (expect_token_with_type(next, err, KwContinue)) {
-      if (!expect_token_with_str(next, err, "\n")) return nullptr;
-      return std::make_shared<ASTContinueStmt>();
-    }
-    if (expect_token_with_type(next, err, KwReturn)) {
-      std::shared_ptr<ASTReturnStmt> ret = std::make_shared<ASTReturnStmt>();
-      if (!(ret->expr = parse_expr(next, err))) return nullptr;
-      if (!expect_token_with_str(next, err, "\n")) return nullptr;
-      return ret;
-    }
-    if (expect_token_with_type(next, err, KwIf)) {
-      std::shared_ptr<ASTIfStmt> ret = std::make_shared<ASTIfStmt>();
-      if (!(ret->cond = parse_expr(next, err))) return nullptr;
-      if (!expect_token_with_str(next, err, "\n")) return nullptr;
-      if (!(ret->true_stmt = parse_comp_stmt(next, err, indents + 2))) return nullptr;
-      Token *saved_token = *next;
-      if (!consume_token_with_indents(next, indents)) {
-        *next = saved_token;
-        return ret;
-      }
-      if (!(ret->false_stmt = parse_else_stmt(next, err, indents))) {
-        *next = saved_token;
-        return ret;
-      }
-      return ret;
-    }
-    return parse_expr_stmt(next, err);
-    // TODO: loop
+  typedef AST *(*ItemParser)(TokenIter &next, Error &err, Arena &arena, int indents);
+
+  constexpr std::array<ItemParser, num_token_types> create_item_parsers() {
+    std::array<ItemParser, num_token_types> ret = {};
+    for (ItemParser &p: ret) p = parse_expr_stmt;
+    ret[KwBreak] = parse_break_stmt;
+    ret[KwContinue] = parse_continue_stmt;
+    ret[KwReturn] = parse_return_stmt;
+    ret[KwIf] = parse_if_stmt;
+    ret[KwNum] = parse_declaration;
+    ret[KwInt] = parse_declaration;
+    ret[KwStr] = parse_declaration;
+    return ret;
   }
+  constexpr std::array<ItemParser, num_token_types> item_parsers = create_item_parsers();
 
-  std::shared_ptr<ASTCompoundStmt> parse_comp_stmt(Token **next, Error &err, int indents) {
-    std::shared_ptr<ASTCompoundStmt> ret = std::make_shared<ASTCompoundStmt>();
-    std::shared_ptr<AST> item;
+  ASTCompoundStmt *parse_comp_stmt(TokenIter &next, Error &err, Arena &arena, int indents) {
+    ASTCompoundStmt *ret = arena.make<ASTCompoundStmt>();
+    AST *item;
+    Token *t;
     while (1) {
-      if (!consume_token_with_indents(next, indents)) {
-        if (!*next || (*next)->sv.front() != ' ' || (int)(*next)->sv.length() < indents) {
-          // compound-stmt end
-          return ret;
-        } else {
+      t = *next;
+      if (!t || t->type != Indent || (int)t->sv.length() < indents) {
+        // compound-stmt end
+        return ret;
+      }
+      if ((int)t->sv.length() > indents) {
         // inner compound-stmt
-          if (!(item = parse_comp_stmt(next, err, indents + 2))) break;
-        }
-      } else if (
-        !(item = parse_declaration(next, err)) &&
-        !(item = parse_stmt(next, err, indents))
-      ) {
-        break;
+        item = parse_comp_stmt(next, err, arena, indents + 2);
+      } else {
+        ++next;
+        t = *next;
+        item = item_parsers[t ? t->type : Unknown](next, err, arena, indents);
       }
+      if (!item) return nullptr;
       ret->items.push_back(item);
-      // if (typeid(*item) == typeid(ASTElseStmt)) {
-      //   if (!ret->items.size()) 
-      // }
-      // if (
-      //   typeid(*ret->items.back()) == typeid(ASTIfStmt) &&
-      //   typeid(*item) == typeid(ASTElseStmt)
-      // ) {
-      //   std::dynamic_pointer_cast<ASTIfStmt>(ret->items.back())
-      //     ->false_stmt = std::dynamic_pointer_cast<ASTElseStmt>(item);
-      // } else if (
-      //   typeid(*ret->items.back()) == typeid(ASTElseStmt) &&
-      //   typeid(*item) == typeid(ASTElseStmt)
-      // ) {
-      //   std::dynamic_pointer_cast<ASTElseStmt>(ret->items.back())
-      //     ->false_stmt = std::dynamic_pointer_cast<ASTElseStmt>(item);
-      // } else {
-      //   ret->items.push_back(item);
-      // }
     }
-    return nullptr;
   }
 
-  std::shared_ptr<ASTFuncDeclarator> parse_func_declarator(Token **next, Error &err) {
+  ASTFuncDeclarator *parse_func_declarator(TokenIter &next, Error &err, Arena &arena) {
   // declarator(declaration, ...)
-    std::shared_ptr<ASTFuncDeclarator> ret = std::make_shared<ASTFuncDeclarator>();
-    if (!(ret->declarator = parse_declarator(next, err))) return nullptr;
-    if (!expect_token_with_str(next, err, "(")) return nullptr;
+    ASTFuncDeclarator *ret = arena.make<ASTFuncDeclarator>();
+    if (!(ret->declarator = parse_declarator(next, err, arena))) return nullptr;
+    if (!expect_token_with_type(next, err, LParenTok)) return nullptr;
 
-    std::shared_ptr<ASTSimpleDeclaration> declaration;
-    while (!expect_token_with_str(next, err, ")")) {
-      if (!(declaration = parse_simple_declaration(next, err))) return nullptr;
+    ASTSimpleDeclaration *declaration;
+    while (!expect_token_with_type(next, err, RParenTok)) {
+      if (!(declaration = parse_simple_declaration(next, err, arena))) return nullptr;
       ret->args.push_back(declaration);
-      if (expect_token_with_str(next, err, ",")) continue;
+      if (expect_token_with_type(next, err, CommaTok)) continue;
       // end
-      if (!expect_token_with_str(next, err, ")")) return nullptr;
+      if (!expect_token_with_type(next, err, RParenTok)) return nullptr;
       break;
     }
     return ret;
   }
 
-  std::shared_ptr<ASTFuncDeclaration> parse_func_declaration(Token **next, Error &err) {
+  ASTFuncDeclaration *parse_func_declaration(TokenIter &next, Error &err, Arena &arena) {
   // func-declarator -> type
-    std::shared_ptr<ASTFuncDeclaration> ret = std::make_shared<ASTFuncDeclaration>();
-    if (!(ret->declarator = parse_func_declarator(next, err))) return nullptr;
+    ASTFuncDeclaration *ret = arena.make<ASTFuncDeclaration>();
+    if (!(ret->declarator = parse_func_declarator(next, err, arena))) return nullptr;
     // token "->" should be here
-    if (!expect_token_with_str(next, err, "->")) return nullptr;
-    if (!(ret->type_spec = parse_type_spec(next, err))) return nullptr;
+    if (!expect_token_with_type(next, err, ArrowTok)) return nullptr;
+    if (!(ret->type_spec = parse_type_spec(next, err, arena))) return nullptr;
     // token LF should be here
-    if (!expect_token_with_str(next, err, "\n")) return nullptr;
+    if (!expect_token_with_type(next, err, LF)) return nullptr;
     return ret;
   }
 
-  std::shared_ptr<ASTFuncDef> parse_func_def(Token **next, Error &err) {
+  ASTFuncDef *parse_func_def(TokenIter &next, Error &err, Arena &arena) {
   // func-declaration compound-stmt
     if (!expect_token_with_type(next, err, KwFunc)) return nullptr;
-    std::shared_ptr<ASTFuncDef> ret = std::make_shared<ASTFuncDef>();
-    if (!(ret->declaration = parse_func_declaration(next, err))) return nullptr;
-    if (!(ret->body = parse_comp_stmt(next, err, 2))) return nullptr;
+    ASTFuncDef *ret = arena.make<ASTFuncDef>();
+    if (!(ret->declaration = parse_func_declaration(next, err, arena))) return nullptr;
+    if (!(ret->body = parse_comp_stmt(next, err, arena, 2))) return nullptr;
     return ret;
   }
 
-  std::shared_ptr<ASTExternalDeclaration> parse_external_declaration(Token **next, Error &err) {
-    std::shared_ptr<ASTExternalDeclaration> ret = std::make_shared<ASTExternalDeclaration>();
-    if (!(ret->declaration_spec = parse_declaration_spec(next, err))) return nullptr;
+  ASTExternalDeclaration *parse_external_declaration(TokenIter &next, Error &err, Arena &arena) {
+    ASTExternalDeclaration *ret = arena.make<ASTExternalDeclaration>();
+    if (!(ret->declaration_spec = parse_declaration_spec(next, err, arena))) return nullptr;
 
-    std::shared_ptr<ASTDeclarator> declarator;
-    while ((declarator = parse_declarator(next, err))) {
+    ASTDeclarator *declarator;
+    while ((declarator = parse_declarator(next, err, arena))) {
       ret->declarators.push_back(declarator);
-      if (expect_token_with_str(next, err, ",")) continue;
+      // init-declarator
+      if (expect_token_with_type(next, err, ColonTok)) {
+        if (!(declarator->init = parse_expr(next, err, arena))) return nullptr;
+      }
+      if (expect_token_with_type(next, err, CommaTok)) continue;
       // declaration end
-      if (expect_token_with_str(next, err, "\n")) return ret;
+      if (expect_token_with_type(next, err, LF)) return ret;
       break;
     }
     return nullptr;
   }
 
-  std::shared_ptr<ASTTranslationUnit> parse_translation_unit(Token **next, Error &err) {
-    std::shared_ptr<ASTTranslationUnit> ret = std::make_shared<ASTTranslationUnit>();
+  ASTTranslationUnit *parse_translation_unit(TokenIter &next, Error &err, Arena &arena) {
+    ASTTranslationUnit *ret = arena.make<ASTTranslationUnit>();
 
-    std::shared_ptr<AST> external_declaration;
+    AST *external_declaration;
     while (*next) {
-      if ((*next)->sv == "func") external_declaration = parse_func_def(next, err);
-      else external_declaration = parse_external_declaration(next, err);
+      if ((*next)->type == KwFunc) {
+        external_declaration = parse_func_def(next, err, arena);
+      } else {
+        err.expect(next, KwFunc);
+        external_declaration = parse_external_declaration(next, err, arena);
+      }
       if (!external_declaration) return nullptr;
       ret->external_declarations.push_back(external_declaration);
     }
     return ret;
   }
 
-  void init_parser(Token **head_token) {
-    // *head_token can be NULL
-    Token *next = *head_token;
-    Token *t, *bef;
-    while (next) {
-      // if next token is Delimiter, remove it and continue
-      t = consume_token_with_type(&next, Delimiter);    
-      if (!t) break;
-      delete t;
+  ASTTranslationUnit *parse(TokenStream &tokens, Arena &arena, Error &err) {
+    TokenIter next(tokens);
+    // skip first LF punctuator
+    consume_token_with_type(next, LF);
+    return parse_translation_unit(next, err, arena);
+  }
+
+  ASTTranslationUnit *parse(std::vector<Token> &tokens, Arena &arena, Error &err) {
+    TokenStream stream(tokens);
+    return parse(stream, arena, err);
+  }
+
+  // a top-level declaration begins at column 0,
+  // which is a token right after LF that is not an Indent
+  size_t next_top_level_begin(std::vector<Token> &tokens, size_t i) {
+    while (i < tokens.size() && !(tokens[i - 1].type == LF && tokens[i].type != Indent)) i++;
+    return i;
+  }
+
+  ASTTranslationUnit *parse(std::vector<Token> &tokens, Arena &arena, Error &err, int jobs) {
+    // threads don't pay for themselves on small sources
+    const size_t min_tokens = 1 << 14;
+    // skip first LF punctuator
+    size_t begin = !tokens.empty() && tokens[0].type == LF;
+    jobs = std::min<size_t>(jobs, (tokens.size() - begin) / min_tokens);
+    if (jobs <= 1) return parse(tokens, arena, err);
+
+    // every part begins at a top-level declaration, and a declaration
+    // never reads the tokens of the next one, so the parts parse
+    // just as they do in one pass
+    std::vector<size_t> begins(jobs + 1);
+    begins[0] = begin;
+    for (int i = 1; i < jobs; i++) {
+      size_t p = std::max(begins[i - 1] + 1, begin + (tokens.size() - begin) * i / jobs);
+      begins[i] = next_top_level_begin(tokens, std::min(p, tokens.size()));
     }
-    // set new head_token
-    *head_token = next;
-    // remove first LF punctuator
-    if (*head_token) {
-      t = consume_token_with_str(head_token, "\n");
-      if (!t) delete t;
+    begins[jobs] = tokens.size();
+
+    std::vector<Arena> arenas(jobs);
+    std::vector<Error> errors(jobs);
+    std::vector<ASTTranslationUnit *> units(jobs);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < jobs; i++) {
+      threads.emplace_back([&, i]() {
+        TokenStream stream(tokens.data() + begins[i], begins[i + 1] - begins[i]);
+        TokenIter next(stream);
+        units[i] = parse_translation_unit(next, errors[i], arenas[i]);
+      });
     }
-    // *head_token can be NULL
-    next = *head_token;
-    while (next) {
-      bef = next;
-      assert(bef->type != Delimiter);
-      next = bef->next;
-      while (next) {
-        // if next token is Delimiter, remove it and continue
-        t = consume_token_with_type(&next, Delimiter);
-        if (!t) break;
-        delete t;
+    for (std::thread &th: threads) th.join();
+
+    // in source order, the first error is the one a single pass stops at
+    ASTTranslationUnit *ret = arena.make<ASTTranslationUnit>();
+    for (int i = 0; i < jobs; i++) {
+      arena.merge(arenas[i]);
+      if (!units[i]) {
+        err = errors[i];
+        return nullptr;
       }
-      bef->next = next;
+      std::vector<AST *> &v = units[i]->external_declarations;
+      ret->external_declarations.insert(ret->external_declarations.end(), v.begin(), v.end());
     }
-  }
-
-  std::shared_ptr<ASTTranslationUnit> parse(Token **head_token, Error &err) {
-    init_parser(head_token);
-    Token *next = *head_token;
-    return parse_translation_unit(&next, err);
+    return ret;
   }
 }
\ No newline at end of file
@@ -10,246 +10,504 @@ namespace generator {
 namespace parser {
   using namespace tokenizer;
   using namespace generator;
+  // failures to match a token are the normal path of the parser,
+  // so only the furthest position of them and the kinds of tokens
+  // expected there are recorded; the message is built at the end
   class Error {
     public:
-    Token *token;
-    std::string message;
-    explicit Error(std::string expected, std::string found, Token *t) : token(t) {
-      message = "error: expected " + expected + ", found " + found;
+    size_t pos;
+    std::bitset<num_token_types> expected;
+    // copied, the token may leave the window of a TokenStream
+    // nullopt at EOF
+    std::optional<Token> token;
+    Error() : pos(0) {}
+    void expect(TokenIter &next, const std::bitset<num_token_types> &types) {
+      if (next.pos < pos) return;
+      if (next.pos > pos || expected.none()) {
+        pos = next.pos;
+        expected.reset();
+        token.reset();
+        if (*next) token = **next;
+      }
+      expected |= types;
     }
-    std::string get_error_string() {
-      std::string ret = "line:" + std::to_string(token->line) +
-                        "/pos:" + std::to_string(token->pos) +
-                        ": " + message + '\n';
-      for (char *p = token->line_begin; *p && *p != '\n'; ret += *p++);
-      ret += '\n';
-      for (int i_ = 1; i_ < (int)token->pos; i_++) ret += ' ';
-      ret += '^';
-      for (int i_ = 1; i_ < (int)token->sv.length(); i_++) ret += '~';
+    void expect(TokenIter &next, TokenType type) {
+      expect(next, std::bitset<num_token_types>().set(type));
+    }
+    std::string get_error_string(LineTable &lines);
+  };
+
+  // bump allocator for the nodes of one translation unit
+  // nodes are released all at once when the arena is destroyed,
+  // only those owning memory outside the arena are destructed one by one
+  class Arena {
+    public:
+    static constexpr size_t block_size = 1 << 16;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *p, *end;
+    std::vector<std::pair<void *, void (*)(void *)>> dtors;
+    Arena() : p(NULL), end(NULL) {}
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena() {
+      for (auto it = dtors.rbegin(); it != dtors.rend(); it++) it->second(it->first);
+    }
+
+    void *allocate(size_t size, size_t align) {
+      char *ret = (char *)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+      if (!p || ret + size > end) {
+        size_t n = std::max(block_size, size + align);
+        blocks.emplace_back(new char[n]);
+        p = blocks.back().get();
+        end = p + n;
+        ret = (char *)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+      }
+      p = ret + size;
+      return ret;
+    }
+
+    // takes over the nodes of other, built on another thread
+    void merge(Arena &other) {
+      for (std::unique_ptr<char[]> &b: other.blocks) blocks.push_back(std::move(b));
+      dtors.insert(dtors.end(), other.dtors.begin(), other.dtors.end());
+      other.blocks.clear();
+      other.dtors.clear();
+      other.p = other.end = NULL;
+    }
+
+    template <class T, class... Args> T *make(Args&&... args) {
+      T *ret = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+      if constexpr (!std::is_trivially_destructible_v<T>)
+        dtors.emplace_back(ret, [](void *q) { static_cast<T *>(q)->~T(); });
       return ret;
     }
   };
 
+  // every pass dispatches on kind with a switch, see Visitor
   class AST {
     public:
-    virtual ~AST() = default;
+    enum Kind {
+      TypeSpec,
+      SimpleExpr,
+      PrimaryExpr,
+      FuncCallExpr,
+      MultiplicativeExpr,
+      AdditiveExpr,
+      ShiftExpr,
+      RelationalExpr,
+      EqualityExpr,
+      BitwiseAndExpr,
+      BitwiseXorExpr,
+      BitwiseOrExpr,
+      LogicalAndExpr,
+      LogicalOrExpr,
+      AssignExpr,
+      ExprStmt,
+      BreakStmt,
+      ContinueStmt,
+      ReturnStmt,
+      Declarator,
+      Declaration,
+      SimpleDeclaration,
+      CompoundStmt,
+      ElseStmt,
+      IfStmt,
+      FuncDeclarator,
+      FuncDeclaration,
+      FuncDef,
+      ExternalDeclaration,
+      TranslationUnit,
+    };
+    Kind kind;
+    AST(Kind k) : kind(k) {}
   };
 
   class ASTTypeSpec : public AST {
     public:
-    Token *op;
-    ASTTypeSpec(Token *t) : AST(), op(t) {}
+    Token op;
+    ASTTypeSpec(Token *t) : AST(TypeSpec), op(*t) {}
   };
 
   class ASTExpr : public AST {
     public:
-    std::shared_ptr<ASTExpr> left, right;
-    std::shared_ptr<EvalType> eval_type;
+    ASTExpr *left, *right;
+    EvalType *eval_type;
     bool is_assignable;
-    ASTExpr() : AST(), is_assignable(false) {}
+    // set by the register generator: the Sethi-Ullman number, registers
+    // needed to evaluate it without spilling, and whether it calls or assigns
+    // (fold sets has_effects too)
+    int num_regs;
+    bool has_effects;
+    ASTExpr(Kind k)
+    : AST(k), left(nullptr), right(nullptr), eval_type(nullptr), is_assignable(false),
+      num_regs(0), has_effects(false) {}
   };
 
   class ASTSimpleExpr : public ASTExpr {
     public:
-    Token *op;
-    ASTSimpleExpr(Token *t) : ASTExpr(), op(t) {}
+    Token op;
+    // where an identifier lives, set by the semantic pass
+    bool is_global;
+    int offset; // from rbp, locals only
+    ASTSimpleExpr(Token *t) : ASTExpr(SimpleExpr), op(*t), is_global(false), offset(0) {}
   };
 
   class ASTPrimaryExpr : public ASTExpr {
     public:
-    std::shared_ptr<ASTExpr> expr;
-    ASTPrimaryExpr() : ASTExpr() {}
+    ASTExpr *expr;
+    ASTPrimaryExpr() : ASTExpr(PrimaryExpr), expr(nullptr) {}
   };
 
   class ASTFuncCallExpr : public ASTExpr {
     public:
-    std::shared_ptr<ASTExpr> primary;
-    std::vector<std::shared_ptr<ASTExpr>> args;
-    ASTFuncCallExpr() : ASTExpr() {
-      args = std::vector<std::shared_ptr<ASTExpr>>();
+    ASTExpr *primary;
+    std::vector<ASTExpr *> args;
+    ASTFuncCallExpr() : ASTExpr(FuncCallExpr), primary(nullptr) {
+      args = std::vector<ASTExpr *>();
     }
   };
 
   class ASTMultiplicativeExpr : public ASTExpr {
     public:
-    Token *op;
-    ASTMultiplicativeExpr(Token *t) : ASTExpr(), op(t) {}
+    Token op;
+    ASTMultiplicativeExpr(Token *t) : ASTExpr(MultiplicativeExpr), op(*t) {}
   };
 
   class ASTAdditiveExpr : public ASTExpr {
     public:
-    Token *op;
-    ASTAdditiveExpr(Token *t) : ASTExpr(), op(t) {}
+    Token op;
+    ASTAdditiveExpr(Token *t) : ASTExpr(AdditiveExpr), op(*t) {}
   };
 
   class ASTShiftExpr : public ASTExpr {
     public:
-    Token *op;
-    ASTShiftExpr(Token *t) : ASTExpr(), op(t) {}
+    Token op;
+    ASTShiftExpr(Token *t) : ASTExpr(ShiftExpr), op(*t) {}
   };
 
   class ASTRelationalExpr : public ASTExpr {
     public:
-    Token *op;
-    ASTRelationalExpr(Token *t) : ASTExpr(), op(t) {}
+    Token op;
+    ASTRelationalExpr(Token *t) : ASTExpr(RelationalExpr), op(*t) {}
   };
 
   class ASTEqualityExpr : public ASTExpr {
     public:
-    Token *op;
-    ASTEqualityExpr(Token *t) : ASTExpr(), op(t) {}
+    Token op;
+    ASTEqualityExpr(Token *t) : ASTExpr(EqualityExpr), op(*t) {}
   };
 
   class ASTBitwiseAndExpr : public ASTExpr {
     public:
-    ASTBitwiseAndExpr() : ASTExpr() {}
+    Token op;
+    ASTBitwiseAndExpr(Token *t) : ASTExpr(BitwiseAndExpr), op(*t) {}
   };
 
   class ASTBitwiseXorExpr : public ASTExpr {
     public:
-    ASTBitwiseXorExpr() : ASTExpr() {}
+    Token op;
+    ASTBitwiseXorExpr(Token *t) : ASTExpr(BitwiseXorExpr), op(*t) {}
   };
 
   class ASTBitwiseOrExpr : public ASTExpr {
     public:
-    ASTBitwiseOrExpr() : ASTExpr() {}
+    Token op;
+    ASTBitwiseOrExpr(Token *t) : ASTExpr(BitwiseOrExpr), op(*t) {}
   };
 
   class ASTLogicalAndExpr : public ASTExpr {
     public:
-    ASTLogicalAndExpr() : ASTExpr() {}
+    Token op;
+    ASTLogicalAndExpr(Token *t) : ASTExpr(LogicalAndExpr), op(*t) {}
   };
 
   class ASTLogicalOrExpr : public ASTExpr {
     public:
-    ASTLogicalOrExpr() : ASTExpr() {}
+    Token op;
+    ASTLogicalOrExpr(Token *t) : ASTExpr(LogicalOrExpr), op(*t) {}
   };
 
   class ASTAssignExpr : public ASTExpr {
     public:
-    ASTAssignExpr() : ASTExpr() {}
+    Token op;
+    ASTAssignExpr(Token *t) : ASTExpr(AssignExpr), op(*t) {}
   };
 
   class ASTExprStmt : public AST {
     public:
-    std::shared_ptr<AST> expr;
-    ASTExprStmt() : AST() {}
+    AST *expr;
+    ASTExprStmt() : AST(ExprStmt), expr(nullptr) {}
   };
 
   class ASTBreakStmt : public AST {
     public:
-    ASTBreakStmt() : AST() {}
+    Token op;
+    ASTBreakStmt(Token *t) : AST(BreakStmt), op(*t) {}
   };
 
   class ASTContinueStmt : public AST {
     public:
-    ASTContinueStmt() : AST() {}
+    Token op;
+    ASTContinueStmt(Token *t) : AST(ContinueStmt), op(*t) {}
   };
 
   class ASTReturnStmt : public AST {
     public:
-    std::shared_ptr<AST> expr;
-    ASTReturnStmt() : AST() {}
+    AST *expr;
+    ASTReturnStmt() : AST(ReturnStmt), expr(nullptr) {}
   };
 
   class ASTDeclarator : public AST {
     public:
-    Token *op;
-    ASTDeclarator(Token *t) : AST(), op(t) {}
+    Token op;
+    ASTExpr *init; // `declarator: expr` of a global, or null
+    // set by the semantic pass
+    EvalType *type;
+    int offset; // from rbp, locals and arguments only
+    ASTDeclarator(Token *t) : AST(Declarator), op(*t), init(nullptr), type(nullptr), offset(0) {}
   };
 
   class ASTDeclaration : public AST {
     public:
-    std::shared_ptr<ASTTypeSpec> declaration_spec;
-    std::vector<std::shared_ptr<ASTDeclarator>> declarators;
-    ASTDeclaration() : AST() {
-      declarators = std::vector<std::shared_ptr<ASTDeclarator>>();
+    ASTTypeSpec *declaration_spec;
+    std::vector<ASTDeclarator *> declarators;
+    ASTDeclaration() : AST(Declaration), declaration_spec(nullptr) {
+      declarators = std::vector<ASTDeclarator *>();
     }
   };
 
   class ASTSimpleDeclaration : public AST {
     public:
-    std::shared_ptr<ASTTypeSpec> type_spec;
-    std::shared_ptr<ASTDeclarator> declarator;
-    ASTSimpleDeclaration() : AST() {}
+    ASTTypeSpec *type_spec;
+    ASTDeclarator *declarator;
+    ASTSimpleDeclaration() : AST(SimpleDeclaration), type_spec(nullptr), declarator(nullptr) {}
   };
 
   class ASTCompoundStmt : public AST {
     public:
-    std::vector<std::shared_ptr<AST>> items;
-    ASTCompoundStmt() : AST() {
-      items = std::vector<std::shared_ptr<AST>>();
+    std::vector<AST *> items;
+    ASTCompoundStmt() : AST(CompoundStmt) {
+      items = std::vector<AST *>();
     }
   };
 
   class ASTElseStmt : public AST {
     public:
-    std::shared_ptr<ASTExpr> cond;
-    std::shared_ptr<ASTCompoundStmt> true_stmt;
-    std::shared_ptr<ASTElseStmt> false_stmt;
-    ASTElseStmt() : AST(), cond(nullptr), false_stmt(nullptr) {}
+    ASTExpr *cond;
+    ASTCompoundStmt *true_stmt;
+    ASTElseStmt *false_stmt;
+    ASTElseStmt() : AST(ElseStmt), cond(nullptr), true_stmt(nullptr), false_stmt(nullptr) {}
   };
 
   class ASTIfStmt : public AST {
     public:
-    std::shared_ptr<ASTExpr> cond;
-    std::shared_ptr<ASTCompoundStmt> true_stmt;
-    std::shared_ptr<ASTElseStmt> false_stmt;
-    ASTIfStmt() : AST(), cond(nullptr), false_stmt(nullptr) {}
+    ASTExpr *cond;
+    ASTCompoundStmt *true_stmt;
+    ASTElseStmt *false_stmt;
+    ASTIfStmt() : AST(IfStmt), cond(nullptr), true_stmt(nullptr), false_stmt(nullptr) {}
   };
 
   class ASTFuncDeclarator : public AST {
     public:
-    std::shared_ptr<ASTDeclarator> declarator;
-    std::vector<std::shared_ptr<ASTSimpleDeclaration>> args;
-    ASTFuncDeclarator() : AST() {
-      args = std::vector<std::shared_ptr<ASTSimpleDeclaration>>();
+    ASTDeclarator *declarator;
+    std::vector<ASTSimpleDeclaration *> args;
+    ASTFuncDeclarator() : AST(FuncDeclarator), declarator(nullptr) {
+      args = std::vector<ASTSimpleDeclaration *>();
     }
   };
 
   class ASTFuncDeclaration : public AST {
     public:
-    std::shared_ptr<ASTTypeSpec> type_spec;
-    std::shared_ptr<ASTFuncDeclarator> declarator;
-    ASTFuncDeclaration() : AST() {}
+    ASTTypeSpec *type_spec;
+    ASTFuncDeclarator *declarator;
+    ASTFuncDeclaration() : AST(FuncDeclaration), type_spec(nullptr), declarator(nullptr) {}
   };
 
   class ASTFuncDef : public AST {
     public:
-    std::shared_ptr<ASTFuncDeclaration> declaration;
-    std::shared_ptr<ASTCompoundStmt> body;
-    ASTFuncDef() : AST() {}
+    ASTFuncDeclaration *declaration;
+    ASTCompoundStmt *body;
+    int frame_size; // bytes of arguments and locals, set by the semantic pass
+    ASTFuncDef() : AST(FuncDef), declaration(nullptr), body(nullptr), frame_size(0) {}
   };
 
   class ASTExternalDeclaration : public AST {
     public:
-    std::shared_ptr<ASTTypeSpec> declaration_spec;
-    std::vector<std::shared_ptr<ASTDeclarator>> declarators;
-    ASTExternalDeclaration() : AST() {
-      declarators = std::vector<std::shared_ptr<ASTDeclarator>>();
+    ASTTypeSpec *declaration_spec;
+    std::vector<ASTDeclarator *> declarators;
+    ASTExternalDeclaration() : AST(ExternalDeclaration), declaration_spec(nullptr) {
+      declarators = std::vector<ASTDeclarator *>();
     }
   };
 
   class ASTTranslationUnit : public AST {
     public:
-    std::vector<std::shared_ptr<AST>> external_declarations;
-    ASTTranslationUnit() : AST() {
-      external_declarations = std::vector<std::shared_ptr<AST>>();
+    std::vector<AST *> external_declarations;
+    ASTTranslationUnit() : AST(TranslationUnit) {
+      external_declarations = std::vector<AST *>();
     }
   };
 
-  bool is_unary_expr(std::shared_ptr<AST> node);
+  // utils.cpp
+  const char *kind_name(AST::Kind kind);
+
+  // dispatch on the kind of a node with one switch and static_cast
+  // a pass derives from Visitor<Pass, Ret> and hides the visit_* it handles,
+  // the others fall back to visit_binary_expr or visit_default
+  template <class Derived, class Ret = void> class Visitor {
+    public:
+    Ret visit(AST *n) {
+      Derived *self = static_cast<Derived *>(this);
+      switch (n->kind) {
+      case AST::TypeSpec:
+        return self->visit_type_spec(static_cast<ASTTypeSpec *>(n));
+      case AST::SimpleExpr:
+        return self->visit_simple_expr(static_cast<ASTSimpleExpr *>(n));
+      case AST::PrimaryExpr:
+        return self->visit_primary_expr(static_cast<ASTPrimaryExpr *>(n));
+      case AST::FuncCallExpr:
+        return self->visit_func_call_expr(static_cast<ASTFuncCallExpr *>(n));
+      case AST::MultiplicativeExpr:
+        return self->visit_multiplicative_expr(static_cast<ASTMultiplicativeExpr *>(n));
+      case AST::AdditiveExpr:
+        return self->visit_additive_expr(static_cast<ASTAdditiveExpr *>(n));
+      case AST::ShiftExpr:
+        return self->visit_shift_expr(static_cast<ASTShiftExpr *>(n));
+      case AST::RelationalExpr:
+        return self->visit_relational_expr(static_cast<ASTRelationalExpr *>(n));
+      case AST::EqualityExpr:
+        return self->visit_equality_expr(static_cast<ASTEqualityExpr *>(n));
+      case AST::BitwiseAndExpr:
+        return self->visit_bitwise_and_expr(static_cast<ASTBitwiseAndExpr *>(n));
+      case AST::BitwiseXorExpr:
+        return self->visit_bitwise_xor_expr(static_cast<ASTBitwiseXorExpr *>(n));
+      case AST::BitwiseOrExpr:
+        return self->visit_bitwise_or_expr(static_cast<ASTBitwiseOrExpr *>(n));
+      case AST::LogicalAndExpr:
+        return self->visit_logical_and_expr(static_cast<ASTLogicalAndExpr *>(n));
+      case AST::LogicalOrExpr:
+        return self->visit_logical_or_expr(static_cast<ASTLogicalOrExpr *>(n));
+      case AST::AssignExpr:
+        return self->visit_assign_expr(static_cast<ASTAssignExpr *>(n));
+      case AST::ExprStmt:
+        return self->visit_expr_stmt(static_cast<ASTExprStmt *>(n));
+      case AST::BreakStmt:
+        return self->visit_break_stmt(static_cast<ASTBreakStmt *>(n));
+      case AST::ContinueStmt:
+        return self->visit_continue_stmt(static_cast<ASTContinueStmt *>(n));
+      case AST::ReturnStmt:
+        return self->visit_return_stmt(static_cast<ASTReturnStmt *>(n));
+      case AST::Declarator:
+        return self->visit_declarator(static_cast<ASTDeclarator *>(n));
+      case AST::Declaration:
+        return self->visit_declaration(static_cast<ASTDeclaration *>(n));
+      case AST::SimpleDeclaration:
+        return self->visit_simple_declaration(static_cast<ASTSimpleDeclaration *>(n));
+      case AST::CompoundStmt:
+        return self->visit_comp_stmt(static_cast<ASTCompoundStmt *>(n));
+      case AST::ElseStmt:
+        return self->visit_else_stmt(static_cast<ASTElseStmt *>(n));
+      case AST::IfStmt:
+        return self->visit_if_stmt(static_cast<ASTIfStmt *>(n));
+      case AST::FuncDeclarator:
+        return self->visit_func_declarator(static_cast<ASTFuncDeclarator *>(n));
+      case AST::FuncDeclaration:
+        return self->visit_func_declaration(static_cast<ASTFuncDeclaration *>(n));
+      case AST::FuncDef:
+        return self->visit_func_def(static_cast<ASTFuncDef *>(n));
+      case AST::ExternalDeclaration:
+        return self->visit_external_declaration(static_cast<ASTExternalDeclaration *>(n));
+      case AST::TranslationUnit:
+        return self->visit_translation_unit(static_cast<ASTTranslationUnit *>(n));
+      }
+      assert(false);
+      return Ret();
+    }
+    Ret visit_type_spec(ASTTypeSpec *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_simple_expr(ASTSimpleExpr *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_primary_expr(ASTPrimaryExpr *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_func_call_expr(ASTFuncCallExpr *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_multiplicative_expr(ASTMultiplicativeExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_additive_expr(ASTAdditiveExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_shift_expr(ASTShiftExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_relational_expr(ASTRelationalExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_equality_expr(ASTEqualityExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_bitwise_and_expr(ASTBitwiseAndExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_bitwise_xor_expr(ASTBitwiseXorExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_bitwise_or_expr(ASTBitwiseOrExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_logical_and_expr(ASTLogicalAndExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_logical_or_expr(ASTLogicalOrExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_assign_expr(ASTAssignExpr *n) { return static_cast<Derived *>(this)->visit_binary_expr(n); }
+    Ret visit_expr_stmt(ASTExprStmt *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_break_stmt(ASTBreakStmt *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_continue_stmt(ASTContinueStmt *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_return_stmt(ASTReturnStmt *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_declarator(ASTDeclarator *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_declaration(ASTDeclaration *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_simple_declaration(ASTSimpleDeclaration *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_comp_stmt(ASTCompoundStmt *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_else_stmt(ASTElseStmt *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_if_stmt(ASTIfStmt *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_func_declarator(ASTFuncDeclarator *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_func_declaration(ASTFuncDeclaration *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_func_def(ASTFuncDef *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_external_declaration(ASTExternalDeclaration *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_translation_unit(ASTTranslationUnit *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    Ret visit_binary_expr(ASTExpr *n) { return static_cast<Derived *>(this)->visit_default(n); }
+    // a kind the pass does not handle is a bug in the pass
+    Ret visit_default(AST *n) {
+      std::cerr << "unhandled " << kind_name(n->kind) << std::endl;
+      std::abort();
+    }
+  };
+
+  bool is_unary_expr(AST *node);
+
+  // the same tree in flat arrays, one element per node in each
+  // children always come before their parent (post-order), so a pass
+  // can walk the nodes in a plain loop and the root is the last one
+  //   token: index into the token vector, or none
+  //   lhs, rhs: child node indices, or an index into extra
+  //             for a list, stored there as its length and then the nodes
+  // see flat.cpp for the fields of each kind
+  class FlatAST {
+    public:
+    static const uint32_t none = UINT32_MAX;
+    std::vector<uint8_t> kinds;
+    std::vector<uint32_t> tokens;
+    std::vector<uint32_t> lhs, rhs;
+    std::vector<uint32_t> extra;
+
+    uint32_t size() const { return kinds.size(); }
+    uint32_t root() const { return size() - 1; }
+    AST::Kind kind(uint32_t n) const { return (AST::Kind)kinds[n]; }
+    uint32_t list_size(uint32_t l) const { return extra[l]; }
+    uint32_t list_at(uint32_t l, uint32_t i) const { return extra[l + 1 + i]; }
+    size_t bytes() const {
+      return kinds.capacity() * sizeof(uint8_t) +
+             (tokens.capacity() + lhs.capacity() + rhs.capacity() + extra.capacity()) *
+               sizeof(uint32_t);
+    }
+  };
 
   // parser.cpp
-  std::shared_ptr<ASTTranslationUnit> parse(Token **head, Error &err);
-  void print_ast(std::shared_ptr<AST> n);
+  // nodes are allocated from arena and live as long as it
+  ASTTranslationUnit *parse(TokenStream &tokens, Arena &arena, Error &err);
+  ASTTranslationUnit *parse(std::vector<Token> &tokens, Arena &arena, Error &err);
+  // parses top-level declarations on `jobs` threads
+  ASTTranslationUnit *parse(std::vector<Token> &tokens, Arena &arena, Error &err, int jobs);
+  void print_ast(AST *n);
+
+  // flat.cpp, only linked into bench/ast_bench
+  // tokens must be the vector the tree was parsed from
+  FlatAST flatten(AST *root, std::vector<Token> &tokens);
+  void print_flat_ast(FlatAST &ast, std::vector<Token> &tokens);
 
   // utils.cpp
-  Token *expect_token_with_str(Token **next, Error &err, std::string str);
-  Token *consume_token_with_str(Token **next, std::string str);
-  Token *expect_token_with_type(Token **next, Error &err, TokenType type);
-  Token *consume_token_with_type(Token **next, TokenType type);
-  Token *consume_token_with_indents(Token **next, int indents);
-  Token *expect_token_with_indents(Token **next, Error &err, int indents);
+  Token *expect_token_with_type(TokenIter &next, Error &err, TokenType type);
+  Token *consume_token_with_type(TokenIter &next, TokenType type);
+  Token &binary_operator(ASTExpr *n);
+  // "line:L/pos:C: message", then the line with token underlined
+  std::string get_located_string(LineTable &lines, Token &token, const std::string &message);
 }
 #endif
\ No newline at end of file
@@ -1,343 +1,337 @@
 #include "./parser.hpp"
 
 namespace parser {
-  bool is_unary_expr(std::shared_ptr<AST> node) {
+  bool is_unary_expr(AST *node) {
     return (
-      typeid(*node) == typeid(ASTSimpleExpr) ||
-      typeid(*node) == typeid(ASTPrimaryExpr) ||
-      typeid(*node) == typeid(ASTFuncCallExpr)
+      node->kind == AST::SimpleExpr ||
+      node->kind == AST::PrimaryExpr ||
+      node->kind == AST::FuncCallExpr
     );
   }
 
-  tokenizer::Token *expect_token_with_str(tokenizer::Token **next, Error &err, std::string str) {
-    if (!*next) {
-      err = Error(str, "EOF", *next);
-      return NULL;
-    }
-    if ((*next)->sv != str) {
-      err = Error(str, std::string((*next)->sv), *next);
+  tokenizer::Token *expect_token_with_type(tokenizer::TokenIter &next, Error &err, tokenizer::TokenType type) {
+    if (!*next || (*next)->type != type) {
+      err.expect(next, type);
       return NULL;
     }
     tokenizer::Token *ret = *next;
-    *next = (*next)->next;
+    ++next;
     return ret;
   }
 
-  tokenizer::Token *consume_token_with_str(tokenizer::Token **next, std::string str) {
-    if (!*next) return NULL;
-    if ((*next)->sv != str) return NULL;
-    tokenizer::Token *ret = *next;
-    *next = (*next)->next;
+  std::string describe_token_type(tokenizer::TokenType type) {
+    if (type == tokenizer::LF) return "end of line";
+    if (type == tokenizer::Indent) return "indentation";
+    std::string_view spelling = tokenizer::to_spelling(type);
+    if (!spelling.empty()) return '`' + std::string(spelling) + '`';
+    return tokenizer::to_ast_string(type);
+  }
+
+  bool is_binary_operator(tokenizer::TokenType type) {
+    return tokenizer::PlusTok <= type && type <= tokenizer::GreaterGreaterTok &&
+           type != tokenizer::TildeTok && type != tokenizer::EqualTok;
+  }
+
+  std::string Error::get_error_string(LineTable &lines) {
+    // every binary operator may follow an operand,
+    // they are shown as one item
+    std::vector<std::string> items;
+    bool has_operator = false;
+    for (int i = 0; i < tokenizer::num_token_types; i++) {
+      if (!expected[i]) continue;
+      if (is_binary_operator((tokenizer::TokenType)i)) has_operator = true;
+      else items.push_back(describe_token_type((tokenizer::TokenType)i));
+    }
+    if (has_operator) items.push_back("operator");
+
+    std::string message = "error: expected ";
+    if (items.size() > 1) message += "one of ";
+    for (int i = 0; i < (int)items.size(); i++) message += (i ? ", " : "") + items[i];
+    message += ", found ";
+    if (!token) return message + "EOF";
+    if (token->type == tokenizer::LF || token->type == tokenizer::Indent)
+      message += describe_token_type(token->type);
+    else if (token->type == tokenizer::Unknown && token->sv[0] == ' ')
+      message += "indentation of " + std::to_string(token->sv.length()) + " spaces";
+    else
+      message += '`' + std::string(token->sv) + '`';
+
+    return get_located_string(lines, *token, message);
+  }
+
+  std::string get_located_string(LineTable &lines, tokenizer::Token &token, const std::string &message) {
+    int line = lines.line(token.sv.data());
+    int pos = lines.column(token.sv.data());
+    std::string ret = lines.path ? std::string(lines.path) + ':' : "";
+    ret += "line:" + std::to_string(line) +
+           "/pos:" + std::to_string(pos) +
+           ": " + message + '\n';
+    const char *end = lines.src.data() + lines.src.length();
+    for (const char *p = lines.line_begin(line); p < end && *p != '\n'; ret += *p++);
+    ret += '\n';
+    for (int i_ = 1; i_ < pos; i_++) ret += ' ';
+    ret += '^';
+    for (int i_ = 1; i_ < (int)token.sv.length(); i_++) ret += '~';
     return ret;
   }
 
-  tokenizer::Token *expect_token_with_type(tokenizer::Token **next, Error &err, tokenizer::TokenType type) {
-    if (!*next) {
-      err = Error("type " + tokenizer::to_ast_string(type), "EOF", *next);
-      return NULL;
-    }
-    if ((*next)->type != type) {
-      err = Error(
-        "type " + tokenizer::to_ast_string(type),
-        "type " + tokenizer::to_ast_string((*next)->type), *next
-      );
-      return NULL;
+  tokenizer::Token &binary_operator(ASTExpr *n) {
+    switch (n->kind) {
+    case AST::MultiplicativeExpr:
+      return static_cast<ASTMultiplicativeExpr *>(n)->op;
+    case AST::AdditiveExpr:
+      return static_cast<ASTAdditiveExpr *>(n)->op;
+    case AST::ShiftExpr:
+      return static_cast<ASTShiftExpr *>(n)->op;
+    case AST::RelationalExpr:
+      return static_cast<ASTRelationalExpr *>(n)->op;
+    case AST::EqualityExpr:
+      return static_cast<ASTEqualityExpr *>(n)->op;
+    case AST::BitwiseAndExpr:
+      return static_cast<ASTBitwiseAndExpr *>(n)->op;
+    case AST::BitwiseXorExpr:
+      return static_cast<ASTBitwiseXorExpr *>(n)->op;
+    case AST::BitwiseOrExpr:
+      return static_cast<ASTBitwiseOrExpr *>(n)->op;
+    case AST::LogicalAndExpr:
+      return static_cast<ASTLogicalAndExpr *>(n)->op;
+    case AST::LogicalOrExpr:
+      return static_cast<ASTLogicalOrExpr *>(n)->op;
+    default:
+      assert(n->kind == AST::AssignExpr);
+      return static_cast<ASTAssignExpr *>(n)->op;
     }
-    tokenizer::Token *ret = *next;
-    *next = (*next)->next;
-    return ret;
   }
 
-  tokenizer::Token *consume_token_with_type(tokenizer::Token **next, tokenizer::TokenType type) {
+  tokenizer::Token *consume_token_with_type(tokenizer::TokenIter &next, tokenizer::TokenType type) {
     if (!*next) return NULL;
     if ((*next)->type != type) return NULL;
     tokenizer::Token *ret = *next;
-    *next = (*next)->next;
+    ++next;
     return ret;
   }
 
-  tokenizer::Token *consume_token_with_indents(tokenizer::Token **next, int indents) {
-    if (!*next) return NULL;
-    if ((*next)->sv.front() != ' ' || (int)(*next)->sv.length() != indents) return NULL;
-    tokenizer::Token *ret = *next;
-    *next = (*next)->next;
-    return ret;
+  const char *kind_name(AST::Kind kind) {
+    switch (kind) {
+    case AST::TypeSpec:
+      return "TypeSpec";
+    case AST::SimpleExpr:
+      return "SimpleExpr";
+    case AST::PrimaryExpr:
+      return "PrimaryExpr";
+    case AST::FuncCallExpr:
+      return "FuncCallExpr";
+    case AST::MultiplicativeExpr:
+      return "MultiplicativeExpr";
+    case AST::AdditiveExpr:
+      return "AdditiveExpr";
+    case AST::ShiftExpr:
+      return "ShiftExpr";
+    case AST::RelationalExpr:
+      return "RelationalExpr";
+    case AST::EqualityExpr:
+      return "EqualityExpr";
+    case AST::BitwiseAndExpr:
+      return "BitwiseAndExpr";
+    case AST::BitwiseXorExpr:
+      return "BitwiseXorExpr";
+    case AST::BitwiseOrExpr:
+      return "BitwiseOrExpr";
+    case AST::LogicalAndExpr:
+      return "LogicalAndExpr";
+    case AST::LogicalOrExpr:
+      return "LogicalOrExpr";
+    case AST::AssignExpr:
+      return "AssignExpr";
+    case AST::ExprStmt:
+      return "ExprStmt";
+    case AST::BreakStmt:
+      return "BreakStmt";
+    case AST::ContinueStmt:
+      return "ContinueStmt";
+    case AST::ReturnStmt:
+      return "ReturnStmt";
+    case AST::Declarator:
+      return "Declarator";
+    case AST::Declaration:
+      return "Declaration";
+    case AST::SimpleDeclaration:
+      return "SimpleDeclaration";
+    case AST::CompoundStmt:
+      return "CompoundStmt";
+    case AST::ElseStmt:
+      return "ElseStmt";
+    case AST::IfStmt:
+      return "IfStmt";
+    case AST::FuncDeclarator:
+      return "FuncDeclarator";
+    case AST::FuncDeclaration:
+      return "FuncDeclaration";
+    case AST::FuncDef:
+      return "FuncDef";
+    case AST::ExternalDeclaration:
+      return "ExternalDeclaration";
+    case AST::TranslationUnit:
+      return "TranslationUnit";
+    }
+    return "";
   }
 
-  template <class T> void print_ast_vec(std::vector<std::shared_ptr<T>> &v, int depth) {
-    std::cerr << '[';
-    if (v.size() == 0) {
+  class ASTPrinter : public Visitor<ASTPrinter> {
+    public:
+    int depth;
+    ASTPrinter() : depth(0) {}
+
+    template <class T> void print_vec(std::vector<T *> &v) {
+      std::cerr << '[';
+      if (v.size() == 0) {
+        std::cerr << ']';
+        return;
+      }
+      depth++;
+      for (int i=0; i < (int)v.size(); i++) {
+        std::cerr << (i ? ",\n" : "\n");
+        for (int j_ = 0; j_ < depth; j_++) std::cerr << ' ';
+        visit(v.at(i));
+      }
+      depth--;
+      std::cerr << std::endl;
+      for (int i_ = 0; i_ < depth; i_++) std::cerr << ' ';
       std::cerr << ']';
-      return;
-    }
-    for (int i=0; i < (int)v.size(); i++) {
-      std::cerr << (i ? ",\n" : "\n");
-      for (int j_ = 0; j_ < depth + 1; j_++) std::cerr << ' ';
-      print_ast_sub(v.at(i), depth + 1);
     }
-    std::cerr << std::endl;
-    for (int i_ = 0; i_ < depth; i_++) std::cerr << ' ';
-    std::cerr << ']';
-  }
 
-  void print_ast_sub(std::shared_ptr<AST> n, int depth) {
-    if (typeid(*n) == typeid(ASTTypeSpec)) {
-      std::shared_ptr<ASTTypeSpec> nn = std::dynamic_pointer_cast<ASTTypeSpec>(n);
-      std::cerr << "TypeSpec<" << nn->op->sv << '>';
-      return;
+    void visit_type_spec(ASTTypeSpec *n) {
+      std::cerr << "TypeSpec<" << n->op.sv << '>';
     }
-    if (typeid(*n) == typeid(ASTSimpleExpr)) {
-      std::shared_ptr<ASTSimpleExpr> nn = std::dynamic_pointer_cast<ASTSimpleExpr>(n);
-      std::cerr << "SimpleExpr<" << nn->op->sv << '>';
-      return;
+    void visit_simple_expr(ASTSimpleExpr *n) {
+      std::cerr << "SimpleExpr<" << n->op.sv << '>';
     }
-    if (typeid(*n) == typeid(ASTPrimaryExpr)) {
-      std::shared_ptr<ASTPrimaryExpr> nn = std::dynamic_pointer_cast<ASTPrimaryExpr>(n);
+    void visit_primary_expr(ASTPrimaryExpr *n) {
       std::cerr << "PrimaryExpr(e=";
-      print_ast_sub(nn->expr, depth);
+      visit(n->expr);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTFuncCallExpr)) {
-      std::shared_ptr<ASTFuncCallExpr> nn = std::dynamic_pointer_cast<ASTFuncCallExpr>(n);
+    void visit_func_call_expr(ASTFuncCallExpr *n) {
       std::cerr << "FuncCallExpr(p=";
-      print_ast_sub(nn->primary, depth);
+      visit(n->primary);
       std::cerr << ", args=";
-      print_ast_vec(nn->args, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTMultiplicativeExpr)) {
-      std::shared_ptr<ASTMultiplicativeExpr> nn = std::dynamic_pointer_cast<ASTMultiplicativeExpr>(n);
-      std::cerr << "MultiplicativeExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
+      print_vec(n->args);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTAdditiveExpr)) {
-      std::shared_ptr<ASTAdditiveExpr> nn = std::dynamic_pointer_cast<ASTAdditiveExpr>(n);
-      std::cerr << "AdditiveExpr(l=";
-      print_ast_sub(nn->left, depth);
+    void visit_binary_expr(ASTExpr *n) {
+      std::cerr << kind_name(n->kind) << "(l=";
+      visit(n->left);
       std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
+      visit(n->right);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTShiftExpr)) {
-      std::shared_ptr<ASTShiftExpr> nn = std::dynamic_pointer_cast<ASTShiftExpr>(n);
-      std::cerr << "ShiftExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTRelationalExpr)) {
-      std::shared_ptr<ASTRelationalExpr> nn = std::dynamic_pointer_cast<ASTRelationalExpr>(n);
-      std::cerr << "RelationalExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTEqualityExpr)) {
-      std::shared_ptr<ASTEqualityExpr> nn = std::dynamic_pointer_cast<ASTEqualityExpr>(n);
-      std::cerr << "EqualityExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTBitwiseAndExpr)) {
-      std::shared_ptr<ASTBitwiseAndExpr> nn = std::dynamic_pointer_cast<ASTBitwiseAndExpr>(n);
-      std::cerr << "BitwiseAndExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTBitwiseXorExpr)) {
-      std::shared_ptr<ASTBitwiseXorExpr> nn = std::dynamic_pointer_cast<ASTBitwiseXorExpr>(n);
-      std::cerr << "BitwiseXorExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTBitwiseOrExpr)) {
-      std::shared_ptr<ASTBitwiseOrExpr> nn = std::dynamic_pointer_cast<ASTBitwiseOrExpr>(n);
-      std::cerr << "BitwiseOrExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTLogicalAndExpr)) {
-      std::shared_ptr<ASTLogicalAndExpr> nn = std::dynamic_pointer_cast<ASTLogicalAndExpr>(n);
-      std::cerr << "LogicalAndExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTLogicalOrExpr)) {
-      std::shared_ptr<ASTLogicalOrExpr> nn = std::dynamic_pointer_cast<ASTLogicalOrExpr>(n);
-      std::cerr << "LogicalOrExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTAssignExpr)) {
-      std::shared_ptr<ASTAssignExpr> nn = std::dynamic_pointer_cast<ASTAssignExpr>(n);
-      std::cerr << "AssignExpr(l=";
-      print_ast_sub(nn->left, depth);
-      std::cerr << ", r=";
-      print_ast_sub(nn->right, depth);
-      std::cerr << ')';
-      return;
-    }
-    if (typeid(*n) == typeid(ASTExprStmt)) {
-      std::shared_ptr<ASTExprStmt> nn = std::dynamic_pointer_cast<ASTExprStmt>(n);
+    void visit_expr_stmt(ASTExprStmt *n) {
       std::cerr << "ExprStmt(expr=";
-      print_ast_sub(nn->expr, depth);
+      visit(n->expr);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTBreakStmt)) {
-      std::shared_ptr<ASTBreakStmt> nn = std::dynamic_pointer_cast<ASTBreakStmt>(n);
+    void visit_break_stmt(ASTBreakStmt *) {
       std::cerr << "BreakStmt";
-      return;
     }
-    if (typeid(*n) == typeid(ASTContinueStmt)) {
-      std::shared_ptr<ASTContinueStmt> nn = std::dynamic_pointer_cast<ASTContinueStmt>(n);
+    void visit_continue_stmt(ASTContinueStmt *) {
       std::cerr << "ContinueStmt";
-      return;
     }
-    if (typeid(*n) == typeid(ASTReturnStmt)) {
-      std::shared_ptr<ASTReturnStmt> nn = std::dynamic_pointer_cast<ASTReturnStmt>(n);
+    void visit_return_stmt(ASTReturnStmt *n) {
       std::cerr << "ReturnStmt(expr=";
-      print_ast_sub(nn->expr, depth);
+      visit(n->expr);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTDeclarator)) {
-      std::shared_ptr<ASTDeclarator> nn = std::dynamic_pointer_cast<ASTDeclarator>(n);
-      std::cerr << "Declarator<" << nn->op->sv << '>';
-      return;
+    void visit_declarator(ASTDeclarator *n) {
+      std::cerr << "Declarator<" << n->op.sv << '>';
+      if (n->init) {
+        std::cerr << "(init=";
+        visit(n->init);
+        std::cerr << ')';
+      }
     }
-    if (typeid(*n) == typeid(ASTDeclaration)) {
-      std::shared_ptr<ASTDeclaration> nn = std::dynamic_pointer_cast<ASTDeclaration>(n);
+    void visit_declaration(ASTDeclaration *n) {
       std::cerr << "Declaration(ds=";
-      print_ast_sub(nn->declaration_spec, depth);
+      visit(n->declaration_spec);
       std::cerr << ", d-list=";
-      print_ast_vec(nn->declarators, depth);
+      print_vec(n->declarators);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTSimpleDeclaration)) {
-      std::shared_ptr<ASTSimpleDeclaration> nn = std::dynamic_pointer_cast<ASTSimpleDeclaration>(n);
+    void visit_simple_declaration(ASTSimpleDeclaration *n) {
       std::cerr << "SimpleDeclaration(ts=";
-      print_ast_sub(nn->type_spec, depth);
+      visit(n->type_spec);
       std::cerr << ", d=";
-      print_ast_sub(nn->declarator, depth);
+      visit(n->declarator);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTCompoundStmt)) {
-      std::shared_ptr<ASTCompoundStmt> nn = std::dynamic_pointer_cast<ASTCompoundStmt>(n);
+    void visit_comp_stmt(ASTCompoundStmt *n) {
       std::cerr << "CompoundStmt(item-list=";
-      print_ast_vec(nn->items, depth);
+      print_vec(n->items);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTIfStmt)) {
-      std::shared_ptr<ASTIfStmt> nn = std::dynamic_pointer_cast<ASTIfStmt>(n);
+    void visit_if_stmt(ASTIfStmt *n) {
       std::cerr << "IfStmt(cond=";
-      print_ast_sub(nn->cond, depth);
+      visit(n->cond);
       std::cerr << ", true-stmt=";
-      print_ast_sub(nn->true_stmt, depth);
-      if (nn->false_stmt) {
+      visit(n->true_stmt);
+      if (n->false_stmt) {
         std::cerr <<", false-stmt=";
-        print_ast_sub(nn->false_stmt, depth);
+        visit(n->false_stmt);
       }
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTElseStmt)) {
-      std::shared_ptr<ASTElseStmt> nn = std::dynamic_pointer_cast<ASTElseStmt>(n);
+    void visit_else_stmt(ASTElseStmt *n) {
       std::cerr << "ElseStmt(";
-      if (nn->cond) {
+      if (n->cond) {
         std::cerr << "cond=";
-        print_ast_sub(nn->cond, depth);
+        visit(n->cond);
       } else {
         std::cerr << "cond=nil";
       }
       std::cerr << ", true-stmt=";
-      print_ast_sub(nn->true_stmt, depth);
-      if (nn->false_stmt) {
+      visit(n->true_stmt);
+      if (n->false_stmt) {
         std::cerr <<", false-stmt=";
-        print_ast_sub(nn->false_stmt, depth);
+        visit(n->false_stmt);
       }
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTFuncDeclarator)) {
-      std::shared_ptr<ASTFuncDeclarator> nn = std::dynamic_pointer_cast<ASTFuncDeclarator>(n);
+    void visit_func_declarator(ASTFuncDeclarator *n) {
       std::cerr << "FuncDeclarator(d=";
-      print_ast_sub(nn->declarator, depth);
+      visit(n->declarator);
       std::cerr << ", args=";
-      print_ast_vec(nn->args, depth);
+      print_vec(n->args);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTFuncDeclaration)) {
-      std::shared_ptr<ASTFuncDeclaration> nn = std::dynamic_pointer_cast<ASTFuncDeclaration>(n);
+    void visit_func_declaration(ASTFuncDeclaration *n) {
       std::cerr << "FuncDeclaration(ts=";
-      print_ast_sub(nn->type_spec, depth);
+      visit(n->type_spec);
       std::cerr << ", d=";
-      print_ast_sub(nn->declarator, depth);
+      visit(n->declarator);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTFuncDef)) {
-      std::shared_ptr<ASTFuncDef> nn = std::dynamic_pointer_cast<ASTFuncDef>(n);
+    void visit_func_def(ASTFuncDef *n) {
       std::cerr << "FuncDef(d=";
-      print_ast_sub(nn->declaration, depth);
+      visit(n->declaration);
       std::cerr << ", body=";
-      print_ast_sub(nn->body, depth);
+      visit(n->body);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTExternalDeclaration)) {
-      std::shared_ptr<ASTExternalDeclaration> nn = std::dynamic_pointer_cast<ASTExternalDeclaration>(n);
+    void visit_external_declaration(ASTExternalDeclaration *n) {
       std::cerr << "ExternalDeclaration(ds=";
-      print_ast_sub(nn->declaration_spec, depth);
+      visit(n->declaration_spec);
       std::cerr << ", d-list=";
-      print_ast_vec(nn->declarators, depth);
+      print_vec(n->declarators);
       std::cerr << ')';
-      return;
     }
-    if (typeid(*n) == typeid(ASTTranslationUnit)) {
-      std::shared_ptr<ASTTranslationUnit> nn = std::dynamic_pointer_cast<ASTTranslationUnit>(n);
+    void visit_translation_unit(ASTTranslationUnit *n) {
       std::cerr << "TranslationUnit(ed-list=";
-      print_ast_vec(nn->external_declarations, depth);
+      print_vec(n->external_declarations);
       std::cerr << ')';
-      return;
     }
-  }
+  };
 
-  void print_ast(std::shared_ptr<AST> n) {
-    print_ast_sub(n, 0);
+  void print_ast(AST *n) {
+    ASTPrinter().visit(n);
     std::cerr << std::endl;
   }
 }
\ No newline at end of file
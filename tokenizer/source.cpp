@@ -0,0 +1,47 @@
+#include "./tokenizer.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tokenizer {
+  Source::~Source() {
+    if (mapped) munmap(mapped, mapped_size);
+  }
+
+  bool open_source(Source &src, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      close(fd);
+      return false;
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        // the lexer reads the source only forward
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        close(fd);
+        src.mapped = p;
+        src.mapped_size = st.st_size;
+        src.sv = std::string_view((const char *)p, st.st_size);
+        return true;
+      }
+    }
+    // pipes, devices and empty files can't be mapped
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) src.buffer.append(buf, n);
+    close(fd);
+    if (n < 0) return false;
+    src.sv = src.buffer;
+    return true;
+  }
+
+  // straight into the buffer, without an ostringstream to copy from
+  void read_source(Source &src, std::istream &is) {
+    src.buffer.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    src.sv = src.buffer;
+  }
+}
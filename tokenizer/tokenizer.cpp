@@ -1,13 +1,72 @@
 #include "./tokenizer.hpp"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace tokenizer {
   std::string to_string(TokenType type) {
     switch (type)
     {
-      case Delimiter:
-        return "Delimiter";
-      case Punctuator:
-        return "Punctuator";
+      case LF:
+        return "LF";
+      case Indent:
+        return "Indent";
+      case CommaTok:
+        return "CommaTok";
+      case ColonTok:
+        return "ColonTok";
+      case LParenTok:
+        return "LParenTok";
+      case RParenTok:
+        return "RParenTok";
+      case LBracketTok:
+        return "LBracketTok";
+      case RBracketTok:
+        return "RBracketTok";
+      case PlusTok:
+        return "PlusTok";
+      case MinusTok:
+        return "MinusTok";
+      case StarTok:
+        return "StarTok";
+      case SlashTok:
+        return "SlashTok";
+      case PercentTok:
+        return "PercentTok";
+      case AmpTok:
+        return "AmpTok";
+      case AmpAmpTok:
+        return "AmpAmpTok";
+      case BarTok:
+        return "BarTok";
+      case BarBarTok:
+        return "BarBarTok";
+      case CaretTok:
+        return "CaretTok";
+      case TildeTok:
+        return "TildeTok";
+      case EqualTok:
+        return "EqualTok";
+      case EqualEqualTok:
+        return "EqualEqualTok";
+      case NotEqualTok:
+        return "NotEqualTok";
+      case LessTok:
+        return "LessTok";
+      case LessEqualTok:
+        return "LessEqualTok";
+      case LessLessTok:
+        return "LessLessTok";
+      case GreaterTok:
+        return "GreaterTok";
+      case GreaterEqualTok:
+        return "GreaterEqualTok";
+      case GreaterGreaterTok:
+        return "GreaterGreaterTok";
+      case ArrowTok:
+        return "ArrowTok";
       case NumberConstant:
         return "NumberConstant";
       case StringLiteral:
@@ -24,8 +83,12 @@ namespace tokenizer {
         return "KwElse";
       case KwFunc:
         return "KwFunc";
+      case KwFuncp:
+        return "KwFuncp";
       case KwIf:
         return "KwIf";
+      case KwInt:
+        return "KwInt";
       case KwLoop:
         return "KwLoop";
       case KwNum:
@@ -42,10 +105,9 @@ namespace tokenizer {
   }
 
   std::string to_ast_string(TokenType type) {
+    if (is_punctuator(type)) return "punctuator";
     switch (type)
     {
-      case Punctuator:
-        return "punctuator";
       case NumberConstant:
         return "number-constant";
       case StringLiteral:
@@ -64,6 +126,8 @@ namespace tokenizer {
         return "external-declaration";
       case KwIf:
         return "if-statement";
+      case KwInt:
+        return "integer-type";
       case KwLoop:
         return "loop-statement";
       case KwNum:
@@ -77,116 +141,525 @@ namespace tokenizer {
     }
   }
 
-  Token *create_next_token_sub(char *src, char *p, int &line, bool is_indent) {
-    assert(line);
-    if (!*p) return NULL;
-    if ('0' <= *p && *p <= '9') {
-      int len = 0;
-      while ('0' <= p[len] && p[len] <= '9') len++;
-      return new Token(line, src, p, len, NumberConstant);
-    }
-    if (('A' <= *p && *p <= 'Z') || ('a' <= *p && *p <= 'z') || *p == '_') {
-      int len = 0;
-      while (('A' <= p[len] && p[len] <= 'Z') ||
-            ('a' <= p[len] && p[len] <= 'z') || p[len] == '_' ||
-            ('0' <= p[len] && p[len] <= '9')) len++;
-      Token *ret = new Token(line, src, p, len, Ident);
-      if (ret->sv == "break") ret->type = KwBreak;            // break
-      else if (ret->sv == "continue") ret->type = KwContinue; // continue
-      else if (ret->sv == "elif") ret->type = KwElif;         // elif
-      else if (ret->sv == "else") ret->type = KwElse;         // else
-      else if (ret->sv == "func") ret->type = KwFunc;         // func
-      else if (ret->sv == "funcp") ret->type = KwFuncp;         // funcp
-      else if (ret->sv == "if") ret->type = KwIf;             // if
-      else if (ret->sv == "loop") ret->type = KwLoop;         // loop
-      else if (ret->sv == "num") ret->type = KwNum;           // num
-      else if (ret->sv == "return") ret->type = KwReturn;     // return
-      else if (ret->sv == "str") ret->type = KwStr;           // str
-      return ret;
-    }
-    if ('!' == *p && p[1] == '=') {
-      return new Token(line, src, p, 2, Punctuator);                         // !=
-    }
-    if ('&' == *p) {
-      if (p[1] == '&') return new Token(line, src, p, 2, Punctuator);        // &&
-      return new Token(line, src, p, 1, Punctuator);                         // &
-    }
-    if ('|' == *p) {
-      if (p[1] == '|') return new Token(line, src, p, 2, Punctuator);        // ||
-      return new Token(line, src, p, 2, Punctuator);                         // |
-    }
-    if ('<' == *p) {
-      if (p[1] == '<') return new Token(line, src, p, 2, Punctuator);        // <<
-      if (p[1] == '=') return new Token(line, src, p, 2, Punctuator);        // <=
-      return new Token(line, src, p, 1, Punctuator);                         // <
-    }
-    if ('>' == *p) {
-      if (p[1] == '>') return new Token(line, src, p, 2, Punctuator);        // >>
-      if (p[1] == '=') return new Token(line, src, p, 2, Punctuator);        // >=
-      return new Token(line, src, p, 1, Punctuator);                         // >
-    }
-    if ('-' == *p) {
-      if (p[1] == '>') return new Token(line, src, p, 2, Punctuator);        // ->
-      return new Token(line, src, p, 1, Punctuator);                         // -
-    }
-    if ('\n' == *p) {
-      line++;
-      if ('\n' == p[1]) return new Token(line-1, src, p, 1, Delimiter);
-      return new Token(line-1, src, p, 1, Punctuator);
-    }
-    if (' ' == *p) {
-      if (!is_indent) return new Token(line, src, p, 1, Delimiter);
-      int len = 0;
-      while (' ' == p[len]) {
-        if (' ' == p[++len]) len++;
-        else return new Token(line, src, p, len, Unknown);
+  std::string_view to_spelling(TokenType type) {
+    switch (type)
+    {
+      case LF:
+        return "\n";
+      case Indent:
+        return "  ";
+      case CommaTok:
+        return ",";
+      case ColonTok:
+        return ":";
+      case LParenTok:
+        return "(";
+      case RParenTok:
+        return ")";
+      case LBracketTok:
+        return "[";
+      case RBracketTok:
+        return "]";
+      case PlusTok:
+        return "+";
+      case MinusTok:
+        return "-";
+      case StarTok:
+        return "*";
+      case SlashTok:
+        return "/";
+      case PercentTok:
+        return "%";
+      case AmpTok:
+        return "&";
+      case AmpAmpTok:
+        return "&&";
+      case BarTok:
+        return "|";
+      case BarBarTok:
+        return "||";
+      case CaretTok:
+        return "^";
+      case TildeTok:
+        return "~";
+      case EqualTok:
+        return "=";
+      case EqualEqualTok:
+        return "==";
+      case NotEqualTok:
+        return "!=";
+      case LessTok:
+        return "<";
+      case LessEqualTok:
+        return "<=";
+      case LessLessTok:
+        return "<<";
+      case GreaterTok:
+        return ">";
+      case GreaterEqualTok:
+        return ">=";
+      case GreaterGreaterTok:
+        return ">>";
+      case ArrowTok:
+        return "->";
+      case KwBreak:
+        return "break";
+      case KwContinue:
+        return "continue";
+      case KwElif:
+        return "elif";
+      case KwElse:
+        return "else";
+      case KwFunc:
+        return "func";
+      case KwFuncp:
+        return "funcp";
+      case KwIf:
+        return "if";
+      case KwLoop:
+        return "loop";
+      case KwNum:
+        return "num";
+      case KwReturn:
+        return "return";
+      case KwStr:
+        return "str";
+      default:
+        return "";
+    }
+  }
+
+  // character classes of the table-driven lexer
+  enum CharClass : uint8_t {
+    CCDigit = 1 << 0, // 0-9
+    CCAlpha = 1 << 1, // A-Z a-z _
+    CCSpace = 1 << 2, // ' '
+    CCLF    = 1 << 3, // \n
+    CCPunct = 1 << 4, // punctuator of 1 character
+    CCOp    = 1 << 5, // punctuator that may have 2 characters
+  };
+
+  constexpr std::array<uint8_t, 256> create_char_class() {
+    std::array<uint8_t, 256> ret = {};
+    for (int c = '0'; c <= '9'; c++) ret[c] = CCDigit;
+    for (int c = 'A'; c <= 'Z'; c++) ret[c] = CCAlpha;
+    for (int c = 'a'; c <= 'z'; c++) ret[c] = CCAlpha;
+    ret['_'] = CCAlpha;
+    ret[' '] = CCSpace;
+    ret['\n'] = CCLF;
+    for (char c: std::string_view(":^~+/*%()[],")) ret[c] = CCPunct;
+    for (char c: std::string_view("!&|<>-=")) ret[c] = CCOp;
+    return ret;
+  }
+
+  constexpr std::array<uint8_t, 256> char_class = create_char_class();
+
+  constexpr std::array<TokenType, 256> create_punct_type() {
+    std::array<TokenType, 256> ret = {};
+    for (int c = 0; c < 256; c++) ret[c] = Unknown;
+    ret[','] = CommaTok;
+    ret[':'] = ColonTok;
+    ret['('] = LParenTok;
+    ret[')'] = RParenTok;
+    ret['['] = LBracketTok;
+    ret[']'] = RBracketTok;
+    ret['+'] = PlusTok;
+    ret['*'] = StarTok;
+    ret['/'] = SlashTok;
+    ret['%'] = PercentTok;
+    ret['^'] = CaretTok;
+    ret['~'] = TildeTok;
+    return ret;
+  }
+
+  // type of punctuators of 1 character
+  constexpr std::array<TokenType, 256> punct_type = create_punct_type();
+
+#if defined(__AVX2__)
+  // bytes of v whose class is in Mask are set to 0xFF
+  template <uint8_t Mask> inline __m256i match_32(__m256i v) {
+    __m256i ret = _mm256_setzero_si256();
+    if constexpr ((Mask & CCDigit) != 0) {
+      ret = _mm256_or_si256(ret, _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v)
+      ));
+    }
+    if constexpr ((Mask & CCAlpha) != 0) {
+      // 'A'-'Z' and 'a'-'z' are same when bit 0x20 is set
+      __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+      ret = _mm256_or_si256(ret, _mm256_and_si256(
+        _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower)
+      ));
+      ret = _mm256_or_si256(ret, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    }
+    if constexpr ((Mask & CCSpace) != 0) {
+      ret = _mm256_or_si256(ret, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    }
+    return ret;
+  }
+#endif
+
+#if defined(__SSE2__)
+  // bytes of v whose class is in Mask are set to 0xFF
+  template <uint8_t Mask> inline __m128i match_16(__m128i v) {
+    __m128i ret = _mm_setzero_si128();
+    if constexpr ((Mask & CCDigit) != 0) {
+      ret = _mm_or_si128(ret, _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+        _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v)
+      ));
+    }
+    if constexpr ((Mask & CCAlpha) != 0) {
+      // 'A'-'Z' and 'a'-'z' are same when bit 0x20 is set
+      __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+      ret = _mm_or_si128(ret, _mm_and_si128(
+        _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+        _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower)
+      ));
+      ret = _mm_or_si128(ret, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    }
+    if constexpr ((Mask & CCSpace) != 0) {
+      ret = _mm_or_si128(ret, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    }
+    return ret;
+  }
+#endif
+
+  // length of the run of characters whose class is in Mask
+  template <uint8_t Mask> int scan_run(const char *p, const char *end) {
+    const char *q = p;
+#if defined(__AVX2__)
+    while (end - q >= 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)q);
+      uint32_t miss = ~(uint32_t)_mm256_movemask_epi8(match_32<Mask>(v));
+      if (miss) return q - p + __builtin_ctz(miss);
+      q += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while (end - q >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)q);
+      uint32_t miss = ~(uint32_t)_mm_movemask_epi8(match_16<Mask>(v)) & 0xFFFF;
+      if (miss) return q - p + __builtin_ctz(miss);
+      q += 16;
+    }
+#endif
+    // scalar fallback and tail
+    while (q < end && (char_class[(unsigned char)*q] & Mask)) q++;
+    return q - p;
+  }
+
+  class Keyword {
+    public:
+    std::string_view sv;
+    TokenType type = Ident;
+  };
+
+  // 予約語
+  // adding a keyword needs only its TokenType and an entry here
+  constexpr Keyword keywords[] = {
+    {"break", KwBreak},
+    {"continue", KwContinue},
+    {"elif", KwElif},
+    {"else", KwElse},
+    {"func", KwFunc},
+    {"funcp", KwFuncp},
+    {"if", KwIf},
+    {"i8", KwInt},
+    {"i16", KwInt},
+    {"i32", KwInt},
+    {"i64", KwInt},
+    {"loop", KwLoop},
+    {"num", KwNum},
+    {"return", KwReturn},
+    {"str", KwStr},
+    {"u8", KwInt},
+    {"u16", KwInt},
+    {"u32", KwInt},
+    {"u64", KwInt},
+  };
+
+  constexpr int keyword_table_bits = 5;
+
+  // multiplicative hash of length, first 2 and last characters
+  // the seed is mixed in before multiplying, as keys like
+  // "i16" and "u16" differ in a few bits only
+  constexpr uint32_t hash_keyword(std::string_view sv, uint32_t seed) {
+    uint32_t key = (uint32_t)sv.length() << 24 |
+                   (uint32_t)(unsigned char)sv.front() << 16 |
+                   (uint32_t)(sv.length() > 1 ? (unsigned char)sv[1] : 0) << 8 |
+                   (uint32_t)(unsigned char)sv.back();
+    return ((key ^ seed) * 0x9E3779B1u) >> (32 - keyword_table_bits);
+  }
+
+  // search the seed that maps all keywords to distinct slots
+  constexpr uint32_t find_keyword_seed() {
+    for (uint32_t seed = 1; seed < 1000000; seed += 2) {
+      bool used[1 << keyword_table_bits] = {};
+      bool ok = true;
+      for (const Keyword &kw: keywords) {
+        uint32_t h = hash_keyword(kw.sv, seed);
+        if (used[h]) {
+          ok = false;
+          break;
+        }
+        used[h] = true;
       }
-      return new Token(line, src, p, len, Punctuator);
+      if (ok) return seed;
     }
-    if (':' == *p || '=' == *p ||
-        '^' == *p || '~' == *p ||
-        '+' == *p ||
-        '/' == *p || '*' == *p || '%' == *p ||
-        '(' == *p || ')' == *p ||
-        '[' == *p || ']' == *p ||
-        ',' == *p) {
-      return new Token(line, src, p, 1, Punctuator);
+    return 0;
+  }
+
+  constexpr uint32_t keyword_seed = find_keyword_seed();
+  static_assert(keyword_seed, "no perfect hash for keywords");
+
+  constexpr std::array<Keyword, 1 << keyword_table_bits> create_keyword_table() {
+    std::array<Keyword, 1 << keyword_table_bits> ret = {};
+    for (const Keyword &kw: keywords) ret[hash_keyword(kw.sv, keyword_seed)] = kw;
+    return ret;
+  }
+
+  constexpr std::array<Keyword, 1 << keyword_table_bits> keyword_table = create_keyword_table();
+
+  // one probe per identifier
+  inline TokenType keyword_type(std::string_view sv) {
+    const Keyword &kw = keyword_table[hash_keyword(sv, keyword_seed)];
+    return kw.sv == sv ? kw.type : Ident;
+  }
+
+  inline std::optional<Token> create_next_token_sub(
+    const char *&p, const char *end, bool is_indent, LineTable &lines
+  ) {
+    // spaces between tokens and empty lines are skipped here,
+    // so no token is created for them
+    while (p < end) {
+      if (*p == ' ' && !is_indent) {
+        p += scan_run<CCSpace>(p, end);
+      } else if (*p == '\n' && p + 1 < end && p[1] == '\n') {
+        lines.line_begins.push_back(++p - lines.src.data());
+        is_indent = false;
+      } else {
+        break;
+      }
+    }
+    if (p == end || !*p) return std::nullopt;
+    // NUL is not a part of any token, so it works as a sentinel
+    char next = p + 1 < end ? p[1] : '\0';
+    switch (char_class[(unsigned char)*p]) {
+    case CCDigit:
+      return Token(p, scan_run<CCDigit>(p, end), NumberConstant);
+    case CCAlpha: {
+      std::string_view sv(p, scan_run<CCAlpha | CCDigit>(p, end));
+      return Token(p, sv.length(), keyword_type(sv));
+    }
+    case CCSpace: {
+      // indents are pairs of spaces
+      int len = scan_run<CCSpace>(p, end);
+      return Token(p, len, len % 2 ? Unknown : Indent);
+    }
+    case CCLF:
+      return Token(p, 1, LF);
+    case CCPunct:
+      return Token(p, 1, punct_type[(unsigned char)*p]);
+    case CCOp:
+      switch (*p) {
+      case '!':
+        if (next == '=') return Token(p, 2, NotEqualTok);
+        break;
+      case '&':
+        if (next == '&') return Token(p, 2, AmpAmpTok);
+        return Token(p, 1, AmpTok);
+      case '|':
+        if (next == '|') return Token(p, 2, BarBarTok);
+        return Token(p, 1, BarTok);
+      case '<':
+        if (next == '<') return Token(p, 2, LessLessTok);
+        if (next == '=') return Token(p, 2, LessEqualTok);
+        return Token(p, 1, LessTok);
+      case '>':
+        if (next == '>') return Token(p, 2, GreaterGreaterTok);
+        if (next == '=') return Token(p, 2, GreaterEqualTok);
+        return Token(p, 1, GreaterTok);
+      case '-':
+        if (next == '>') return Token(p, 2, ArrowTok);
+        return Token(p, 1, MinusTok);
+      case '=':
+        if (next == '=') return Token(p, 2, EqualEqualTok);
+        return Token(p, 1, EqualTok);
+      }
+      break;
+    }
+    return Token(p, 1, Unknown);
+  }
+
+  // 8 bytes at a time, names are short
+  inline uint64_t hash_name(std::string_view sv) {
+    uint64_t h = sv.length();
+    size_t i = 0;
+    for (; i + 8 <= sv.length(); i += 8) {
+      uint64_t w;
+      memcpy(&w, sv.data() + i, 8);
+      h = (h ^ w) * 0x9E3779B97F4A7C15ull;
     }
-    return new Token(line, src, p, 1, Unknown);
+    uint64_t w = 0;
+    memcpy(&w, sv.data() + i, sv.length() - i);
+    h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+    // the high bits are well mixed, bring them down to the index
+    return h ^ (h >> 32);
   }
 
-  Token *create_next_token(char *src, char *p, int &line) {
-    static bool is_indent = true;
-    Token *ret = create_next_token_sub(src, p, line, is_indent);
-    is_indent = ret != NULL &&
-                ret->sv == "\n" && ret->type == Punctuator;
+  uint32_t NameTable::intern(std::string_view sv) {
+    size_t mask = slots.size() - 1;
+    size_t i = hash_name(sv) & mask;
+    for (; slots[i]; i = (i + 1) & mask) {
+      if (names[slots[i] - 1] == sv) return slots[i] - 1;
+    }
+    uint32_t id = names.size();
+    names.push_back(sv);
+    slots[i] = id + 1;
+    // keep the load factor at most 1/2
+    if (names.size() * 2 > slots.size()) {
+      std::vector<uint32_t>(slots.size() * 2).swap(slots);
+      mask = slots.size() - 1;
+      for (uint32_t j = 0; j < names.size(); j++) {
+        size_t k = hash_name(names[j]) & mask;
+        while (slots[k]) k = (k + 1) & mask;
+        slots[k] = j + 1;
+      }
+    }
+    return id;
+  }
+
+  std::optional<Token> Lexer::next() {
+    std::optional<Token> ret = create_next_token_sub(p, end, is_indent, *lines);
+    is_indent = ret && ret->type == LF;
+    if (!ret) return ret;
+    p += ret->sv.length();
+    if (is_indent) lines->line_begins.push_back(p - lines->src.data());
+    if (ret->type == Ident) ret->id = names->intern(ret->sv);
     return ret;
   }
 
-  void print_tokens(Token *head) {
-    for (Token *next = head; next != NULL; next = next->next) {
+  void print_tokens(std::vector<Token> &tokens) {
+    for (Token &t: tokens) {
       std::cerr << "code: ";
-      if (next->sv.front() == ' ')
-        std::cerr << next->sv.length() << " spaces ";
-      else if (next->sv == "\n")
+      if (t.type == Indent)
+        std::cerr << t.sv.length() << " spaces ";
+      else if (t.type == LF)
         std::cerr << "LF ";
       else
-        std::cerr << next->sv << " ";
-      std::cerr << "type: " << to_string(next->type) << std::endl;      
+        std::cerr << t.sv << " ";
+      std::cerr << "type: " << to_string(t.type) << std::endl;
     }
   }
 
-  Token *tokenize(std::string &source) {
-    Token *head = NULL;
-    Token **next = &head;
-    int l = 1;
-    char *p = &source[0];
-    for (Token *t=create_next_token(&source[0], p, l);t!=NULL;) {
-      *next = t;
-      next = &t->next;
-      p += t->sv.length();
-      t = create_next_token(&source[0], p, l);
+  std::vector<Token> tokenize(std::string_view source, LineTable &lines, NameTable &names) {
+    // all tokens live in one contiguous buffer,
+    // so they are released at once with the vector
+    std::vector<Token> tokens;
+    // a token has 2 or more bytes in most cases; pages of the
+    // reservation that are never touched cost nothing
+    tokens.reserve(source.size() / 2 + 1);
+    lines.src = source;
+    Lexer lexer(source.data(), source.data() + source.size(), lines, names);
+    std::optional<Token> t;
+    while ((t = lexer.next())) tokens.push_back(*t);
+    return tokens;
+  }
+
+  // a chunk begins right after an LF token, which is
+  // a \n not followed by \n, so the lexer is at the beginning
+  // of a line there and no token or empty line crosses the border
+  const char *next_chunk_begin(const char *p, const char *end) {
+    while (p < end && !(p[-1] == '\n' && *p != '\n')) p++;
+    return p;
+  }
+
+  std::vector<Token> tokenize(
+    std::string_view source, LineTable &lines, NameTable &names, int jobs
+  ) {
+    // threads don't pay for themselves on small sources
+    const size_t min_chunk_size = 1 << 16;
+    jobs = std::min<size_t>(jobs, source.size() / min_chunk_size);
+    if (jobs <= 1) return tokenize(source, lines, names);
+
+    const char *end = source.data() + source.size();
+    std::vector<const char *> begins(jobs + 1);
+    begins[0] = source.data();
+    for (int i = 1; i < jobs; i++) {
+      const char *p = std::max(begins[i - 1] + 1, source.data() + source.size() * i / jobs);
+      begins[i] = next_chunk_begin(std::min(p, end), end);
     }
-    return head;
+    begins[jobs] = end;
+
+    // offsets in every chunk are from the beginning of the source
+    std::vector<std::vector<Token>> chunks(jobs);
+    std::vector<LineTable> chunk_lines(jobs);
+    std::vector<NameTable> chunk_names(jobs);
+    std::vector<char> stopped(jobs);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < jobs; i++) {
+      threads.emplace_back([&, i]() {
+        chunk_lines[i].src = source;
+        chunk_lines[i].line_begins.clear();
+        chunks[i].reserve((begins[i + 1] - begins[i]) / 2 + 1);
+        Lexer lexer(begins[i], begins[i + 1], chunk_lines[i], chunk_names[i]);
+        std::optional<Token> t;
+        while ((t = lexer.next())) chunks[i].push_back(*t);
+        // NUL ends the source
+        stopped[i] = lexer.p != begins[i + 1];
+      });
+    }
+    for (std::thread &th: threads) th.join();
+
+    // stitch chunks in order, the copies run in parallel too
+    // names are interned again in chunk order, which gives
+    // them the ids of sequential lexing; tokens are renumbered on copy
+    int used = 0;
+    std::vector<size_t> offsets(jobs + 1);
+    std::vector<std::vector<uint32_t>> chunk_ids(jobs);
+    while (used < jobs) {
+      offsets[used + 1] = offsets[used] + chunks[used].size();
+      lines.line_begins.insert(
+        lines.line_begins.end(),
+        chunk_lines[used].line_begins.begin(), chunk_lines[used].line_begins.end()
+      );
+      for (std::string_view name: chunk_names[used].names) {
+        chunk_ids[used].push_back(names.intern(name));
+      }
+      if (stopped[used++]) break;
+    }
+    lines.src = source;
+    std::vector<Token> tokens(offsets[used]);
+    threads.clear();
+    for (int i = 0; i < used; i++) {
+      threads.emplace_back([&, i]() {
+        auto out = tokens.begin() + offsets[i];
+        for (Token &t: chunks[i]) {
+          if (t.type == Ident) t.id = chunk_ids[i][t.id];
+          *out++ = t;
+        }
+        std::vector<Token>().swap(chunks[i]);
+      });
+    }
+    for (std::thread &th: threads) th.join();
+    return tokens;
+  }
+
+  TokenStream::TokenStream(
+    std::string_view source, LineTable &l, NameTable &n, int capacity_bits
+  ) : mask(((size_t)1 << capacity_bits) - 1), capacity((size_t)1 << capacity_bits),
+    filled(0), ring(capacity), lexer(source.data(), source.data() + source.size(), l, n) {
+    data = ring.data();
+    l.src = source;
+  }
+
+  bool TokenStream::fill(size_t pos) {
+    std::optional<Token> t;
+    while (filled <= pos && (t = lexer.next()))
+      data[filled++ & mask] = *t;
+    return filled > pos;
   }
-}
\ No newline at end of file
+}
@@ -4,8 +4,36 @@
 
 namespace tokenizer {
   enum TokenType {
-    Delimiter,      // space
-    Punctuator,     // , ( ) + <- -> = > & * | && || \n
+    // 区切り文字
+    LF,                // \n
+    Indent,            // 2n spaces at the beginning of line
+    CommaTok,          // ,
+    ColonTok,          // :
+    LParenTok,         // (
+    RParenTok,         // )
+    LBracketTok,       // [
+    RBracketTok,       // ]
+    PlusTok,           // +
+    MinusTok,          // -
+    StarTok,           // *
+    SlashTok,          // /
+    PercentTok,        // %
+    AmpTok,            // &
+    AmpAmpTok,         // &&
+    BarTok,            // |
+    BarBarTok,         // ||
+    CaretTok,          // ^
+    TildeTok,          // ~
+    EqualTok,          // =
+    EqualEqualTok,     // ==
+    NotEqualTok,       // !=
+    LessTok,           // <
+    LessEqualTok,      // <=
+    LessLessTok,       // <<
+    GreaterTok,        // >
+    GreaterEqualTok,   // >=
+    GreaterGreaterTok, // >>
+    ArrowTok,          // ->
     // 数値
     NumberConstant, // 0 3 0x07 0b10
     // 文字列リテラル
@@ -20,6 +48,7 @@ namespace tokenizer {
     KwFunc,         // func
     KwFuncp,         // funcp
     KwIf,           // if
+    KwInt,          // i8 i16 i32 i64 u8 u16 u32 u64
     KwLoop,         // loop
     KwNum,          // num
     KwReturn,       // return
@@ -27,32 +56,155 @@ namespace tokenizer {
     // Unexpected Token
     Unknown,        // unknown
   };
+  constexpr int num_token_types = Unknown + 1;
 
   std::string to_string(TokenType type);
   std::string to_ast_string(TokenType type);
+  std::string_view to_spelling(TokenType type);
+
+  inline bool is_punctuator(TokenType type) {
+    return LF <= type && type <= ArrowTok;
+  }
 
   class Token {
     public:
-    int line;
     enum TokenType type;
-    Token *next;
+    uint32_t id; // interned name, Ident only
     std::string_view sv;
-    char *line_begin;
-    int pos;
-    Token(int l, char *src, char *beg, int len, enum TokenType tp)
-    : line(l), type(tp), next(NULL) {
-      sv = std::string_view(beg).substr(0, len);
-      for (
-        line_begin = beg;
-        src < line_begin && line_begin[-1] != '\n';
-        line_begin--
-      );
-      for (pos = 0; line_begin + pos <= beg; pos++);
+    Token() : type(Unknown), id(0) {}
+    Token(const char *beg, int len, enum TokenType tp)
+    : type(tp), id(0), sv(beg, len) {}
+  };
+
+  // identifiers interned to dense ids from 0 in order of appearance,
+  // so later passes can index arrays by name instead of hashing strings
+  class NameTable {
+    public:
+    std::vector<std::string_view> names;
+    // open addressing, id + 1 of each name or 0 for an empty slot
+    std::vector<uint32_t> slots;
+    NameTable() : slots(1 << 10) {}
+    uint32_t intern(std::string_view sv);
+    size_t size() { return names.size(); }
+  };
+
+  // offsets of the beginning of each line
+  // line and column are computed from it only when they are needed
+  class LineTable {
+    public:
+    std::string_view src;
+    const char *path; // printed before line and column, NULL for stdin
+    std::vector<uint32_t> line_begins;
+    LineTable() : path(NULL), line_begins({0}) {}
+    // 1-origin
+    int line(const char *p) {
+      uint32_t offset = p - src.data();
+      return std::upper_bound(
+        line_begins.begin(), line_begins.end(), offset
+      ) - line_begins.begin();
+    }
+    // 1-origin
+    int column(const char *p) {
+      return p - line_begin(line(p)) + 1;
+    }
+    const char *line_begin(int l) {
+      return src.data() + line_begins[l - 1];
     }
   };
 
+  // state of lexing [p, end), one per thread
+  // the lexer never looks at end or beyond
+  class Lexer {
+    public:
+    const char *p, *end;
+    LineTable *lines;
+    NameTable *names;
+    bool is_indent; // at the beginning of a line
+    Lexer(const char *beg, const char *e, LineTable &l, NameTable &n)
+    : p(beg), end(e), lines(&l), names(&n), is_indent(true) {}
+    Lexer() : p(NULL), end(NULL), lines(NULL), names(NULL), is_indent(true) {}
+    // moves p to the end of the returned token
+    std::optional<Token> next();
+  };
+
+  // tokens seen by the parser
+  // batch mode: a view of all tokens lexed in advance
+  // streaming mode: a ring buffer refilled from the lexer on demand,
+  //                 which keeps only the last `capacity` tokens
+  class TokenStream {
+    public:
+    Token *data;
+    size_t mask;     // SIZE_MAX in batch mode
+    size_t capacity; // SIZE_MAX in batch mode
+    size_t filled;   // number of tokens lexed so far
+    // streaming mode only
+    std::vector<Token> ring;
+    Lexer lexer;
+
+    TokenStream(std::vector<Token> &tokens)
+    : data(tokens.data()), mask(SIZE_MAX), capacity(SIZE_MAX),
+      filled(tokens.size()) {}
+    TokenStream(Token *tokens, size_t n)
+    : data(tokens), mask(SIZE_MAX), capacity(SIZE_MAX), filled(n) {}
+    TokenStream(std::string_view source, LineTable &l, NameTable &n, int capacity_bits);
+    TokenStream(const TokenStream &) = delete;
+    TokenStream &operator=(const TokenStream &) = delete;
+
+    // NULL at the end of tokens
+    // in streaming mode the token is overwritten once `capacity` more
+    // tokens are lexed, so a token kept longer than that is copied
+    // a position that already left the window is a bug in the parser
+    Token *at(size_t pos) {
+      if (pos >= filled && !fill(pos)) return NULL;
+      if (filled - pos > capacity) {
+        std::cerr << "token " << pos << " left the window of " << capacity << " tokens" << std::endl;
+        std::abort();
+      }
+      return &data[pos & mask];
+    }
+    bool fill(size_t pos);
+  };
+
+  // cursor of TokenStream, copy it to mark and assign it to reset
+  class TokenIter {
+    public:
+    TokenStream *stream;
+    size_t pos;
+    TokenIter(TokenStream &s) : stream(&s), pos(0) {}
+    // valid as long as TokenStream::at says
+    Token *operator*() const { return stream->at(pos); }
+    Token *peek(int n) const { return stream->at(pos + n); }
+    TokenIter &operator++() {
+      pos++;
+      return *this;
+    }
+  };
+
+  // source code mapped read-only into memory
+  // tokens point straight into it, so it must outlive them
+  class Source {
+    public:
+    std::string_view sv;
+    std::string buffer; // used when the input can't be mapped
+    void *mapped;
+    size_t mapped_size;
+    Source() : mapped(NULL), mapped_size(0) {}
+    Source(const Source &) = delete;
+    Source &operator=(const Source &) = delete;
+    ~Source();
+  };
+
+  // source.cpp
+  bool open_source(Source &src, const char *path);
+  void read_source(Source &src, std::istream &is);
+
   // tokenizer.cpp
-  void print_tokens(Token *head);
-  Token *tokenize(std::string &source);
+  void print_tokens(std::vector<Token> &tokens);
+  std::vector<Token> tokenize(std::string_view source, LineTable &lines, NameTable &names);
+  // lexes chunks of the source on `jobs` threads
+  // names get the same ids as with one thread
+  std::vector<Token> tokenize(
+    std::string_view source, LineTable &lines, NameTable &names, int jobs
+  );
 }
 #endif
\ No newline at end of file